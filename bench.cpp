@@ -0,0 +1,271 @@
+// Benchmark suite for the matching engine
+//
+// Every scenario is a reproducible synthetic order stream (fixed seed) matched on an OrderBook:
+//   throughput  best of --runs replays of the flow through process_orders_with_add_and_cancel, after seeding the book
+//   latency     one more replay timing each order on its own, reported as p50 / p99 / p99.9 / max
+//
+// bench                        table of every scenario
+// bench --json                 the same as one JSON object, to compare builds
+// bench --scenario NAME        only the scenarios whose name contains NAME
+// bench --runs N --orders N    replays per throughput figure, flow orders per scenario
+//
+// Latencies include one clock read, its cost is reported as timer_ns.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <chrono>
+#include <random> // synthetic order flow
+#include "order_book.h" // matching engine
+using namespace std;
+
+#ifdef __VERSION__
+const char* compiler = __VERSION__;
+#else
+const char* compiler = "unknown";
+#endif
+
+struct Scenario {
+    const char* name;
+    const char* description;
+    size_t tickers;
+    size_t depth_levels;  // seeded levels per side of every ticker, passive orders rest anywhere within them
+    int cancel_percent;   // flow orders cancelling a random earlier limit order
+    int market_percent;   // market orders
+    int crossing_percent; // limit orders priced through the touch
+    int market_volume;    // market orders take 1..market_volume
+};
+
+const Scenario scenarios[] = {
+    {"adds_shallow",  "resting limit adds, 1 ticker, 10 levels",               1,    10,  0,  0,  0,  200},
+    {"adds_deep",     "resting limit adds, 1 ticker, 5000 levels",             1,  5000,  0,  0,  0,  200},
+    {"add_cancel",    "50% cancels of random earlier orders, 1 ticker",        1,   100, 50,  5, 20,  200},
+    {"market_sweeps", "50% market orders sweeping several levels",             1,  1000,  0, 50,  0, 2000},
+    {"mixed_shallow", "passive, crossing and market orders, 10 levels",        1,    10,  0, 10, 30,  200},
+    {"mixed_deep",    "passive, crossing and market orders, 5000 levels",      1,  5000,  0, 10, 30,  200},
+    {"many_tickers",  "adds and 30% cancels spread over 256 tickers",        256,    20, 30,  5, 20,  200},
+};
+
+struct Workload {
+    vector<Order> seed; // builds the initial book, not timed
+    vector<Order> flow;
+};
+
+struct Result {
+    const Scenario* scenario;
+    size_t orders;
+    double seconds;       // best replay of the flow
+    double p50, p99, p999, max; // per order latency in ns
+};
+
+
+// Same stream for a scenario on every run and every build
+Workload make_workload(const Scenario& scenario, OrderBook& book, size_t flow_orders){
+    const size_t orders_per_level = 4;
+    Price mid = book.to_ticks(140.00);
+    mt19937_64 rng(42);
+    Workload work;
+    vector<int32_t> cancellable; // ids of earlier limit orders, picked at random and removed by swap and pop
+    int32_t next_id = 0;
+
+    vector<uint32_t> ticker_index(scenario.tickers);
+    for(size_t t = 0; t < scenario.tickers; ++t){
+        ticker_index[t] = book.register_ticker(1000 + (int)t);
+    }
+
+    auto add = [&](vector<Order>& out, size_t t, OrderType type, Side side, Price price, int volume){
+        Order order{};
+        order.id = ++next_id;
+        order.ticker = 1000 + (int)t;
+        order.action = Action::Add;
+        order.type = type;
+        order.side = side;
+        order.ticker_index = ticker_index[t];
+        order.price = type == OrderType::Market ? -1 : price;
+        order.volume = volume;
+        order.cancel_target_id = -1;
+        out.push_back(order);
+        if(type == OrderType::Limit){
+            cancellable.push_back(order.id);
+        }
+    };
+
+    for(size_t t = 0; t < scenario.tickers; ++t){
+        for(size_t level = 1; level <= scenario.depth_levels; ++level){
+            for(size_t i = 0; i < orders_per_level; ++i){
+                add(work.seed, t, OrderType::Limit, Side::Buy, mid - (Price)level, 1 + rng() % 100);
+                add(work.seed, t, OrderType::Limit, Side::Sell, mid + (Price)level, 1 + rng() % 100);
+            }
+        }
+    }
+
+    work.flow.reserve(flow_orders);
+    while(work.flow.size() < flow_orders){
+        int kind = (int)(rng() % 100);
+        if(kind < scenario.cancel_percent){
+            if(cancellable.empty()){
+                continue;
+            }
+            size_t pick = rng() % cancellable.size();
+            Order cancel{};
+            cancel.id = ++next_id;
+            cancel.ticker = -1;
+            cancel.action = Action::Cancel;
+            cancel.type = OrderType::None;
+            cancel.side = Side::None;
+            cancel.price = -1;
+            cancel.volume = -1;
+            cancel.cancel_target_id = cancellable[pick]; // may have been filled already, then the cancel misses
+            cancellable[pick] = cancellable.back();
+            cancellable.pop_back();
+            work.flow.push_back(cancel);
+            continue;
+        }
+        kind -= scenario.cancel_percent;
+
+        size_t t = rng() % scenario.tickers;
+        Side side = rng() % 2 ? Side::Buy : Side::Sell;
+        bool buy = side == Side::Buy;
+        if(kind < scenario.market_percent){
+            add(work.flow, t, OrderType::Market, side, 0, 1 + rng() % scenario.market_volume);
+        }
+        else if(kind < scenario.market_percent + scenario.crossing_percent){ // aggressive limit around the touch
+            Price through = (Price)(rng() % 3);
+            add(work.flow, t, OrderType::Limit, side, buy ? mid + through : mid - through, 1 + rng() % 300);
+        }
+        else{ // passive, rests somewhere in the book
+            Price away = 1 + (Price)(rng() % scenario.depth_levels);
+            add(work.flow, t, OrderType::Limit, side, buy ? mid - away : mid + away, 1 + rng() % 100);
+        }
+    }
+    return work;
+}
+
+
+double timer_overhead_ns(){ // cheapest back to back pair of clock reads
+    double best = numeric_limits<double>::max();
+    for(int i = 0; i < 100000; ++i){
+        auto a = chrono::steady_clock::now();
+        auto b = chrono::steady_clock::now();
+        best = min(best, (double)chrono::duration_cast<chrono::nanoseconds>(b - a).count());
+    }
+    return best;
+}
+
+
+Result run_scenario(const Scenario& scenario, size_t flow_orders, int runs){
+    OrderBook book;
+    Workload work = make_workload(scenario, book, flow_orders);
+    vector<Order> missed; // cancels of filled orders are collected instead of printed
+    missed.reserve(work.flow.size());
+    book.collect_missed_cancels(&missed);
+
+    auto seed_book = [&]{
+        book.reset();
+        missed.clear();
+        book.process_orders_with_add_and_cancel(work.seed);
+    };
+
+    Result result{&scenario, work.flow.size(), numeric_limits<double>::max(), 0, 0, 0, 0};
+    for(int run = 0; run < runs; ++run){
+        seed_book();
+        auto start = chrono::steady_clock::now();
+        book.process_orders_with_add_and_cancel(work.flow);
+        result.seconds = min(result.seconds, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+
+    vector<uint32_t> latency(work.flow.size()); // preallocated so recording does not disturb the book
+    seed_book();
+    const Order* order = work.flow.data();
+    auto last = chrono::steady_clock::now();
+    for(size_t i = 0; i < work.flow.size(); ++i, ++order){
+        book.process_orders_with_add_and_cancel(order, order + 1);
+        auto now = chrono::steady_clock::now();
+        latency[i] = (uint32_t)min<int64_t>(chrono::duration_cast<chrono::nanoseconds>(now - last).count(), UINT32_MAX);
+        last = now;
+    }
+
+    sort(latency.begin(), latency.end());
+    auto percentile = [&](double p){ return latency.empty() ? 0.0 : (double)latency[min(latency.size() - 1, (size_t)(p * latency.size()))]; };
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    result.p999 = percentile(0.999);
+    result.max = latency.empty() ? 0.0 : (double)latency.back();
+    return result;
+}
+
+
+void print_table(const vector<Result>& results, double timer_ns){
+    cout << "scenario      | orders  | orders/s    | p50 ns | p99 ns | p99.9 ns | max ns  | workload" << endl;
+    cout << "--------------+---------+-------------+--------+--------+----------+---------+---------" << endl;
+    for(const Result& r: results){
+        cout << left << setw(13) << r.scenario->name << right << " | " << setw(7) << r.orders << " | " << setw(11) << fixed << setprecision(0) << r.orders / r.seconds
+             << " | " << setw(6) << r.p50 << " | " << setw(6) << r.p99 << " | " << setw(8) << r.p999 << " | " << setw(7) << r.max << " | " << r.scenario->description << endl;
+    }
+    cout << "timer overhead " << timer_ns << " ns per order, included in the latencies" << endl;
+}
+
+
+void print_json(const vector<Result>& results, double timer_ns, int runs){
+    cout << "{\n  \"compiler\": \"" << compiler << "\",\n  \"runs\": " << runs << ",\n  \"timer_ns\": " << fixed << setprecision(1) << timer_ns << ",\n  \"scenarios\": [";
+    for(size_t i = 0; i < results.size(); ++i){
+        const Result& r = results[i];
+        cout << (i ? "," : "") << "\n    {\"name\": \"" << r.scenario->name << "\", \"orders\": " << r.orders
+             << setprecision(6) << ", \"seconds\": " << r.seconds << setprecision(0) << ", \"orders_per_sec\": " << r.orders / r.seconds
+             << ", \"latency_ns\": {\"p50\": " << r.p50 << ", \"p99\": " << r.p99 << ", \"p99_9\": " << r.p999 << ", \"max\": " << r.max << "}}";
+    }
+    cout << "\n  ]\n}" << endl;
+}
+
+
+int main(int argc, char* argv[]){
+    bool json = false;
+    string filter;
+    int runs = 5;
+    size_t flow_orders = 1000000;
+
+    try{
+        for(int i = 1; i < argc; ++i){
+            string arg = argv[i];
+            if(arg == "--json"){
+                json = true;
+            }
+            else if(arg == "--scenario" && i + 1 < argc){
+                filter = argv[++i];
+            }
+            else if(arg == "--runs" && i + 1 < argc){
+                runs = max(stoi(argv[++i]), 1);
+            }
+            else if(arg == "--orders" && i + 1 < argc){
+                flow_orders = max<size_t>(stoul(argv[++i]), 1);
+            }
+            else{
+                cerr << "usage: bench [--json] [--scenario NAME] [--runs N] [--orders N]" << endl;
+                return 1;
+            }
+        }
+    }
+    catch(const exception& e){
+        cerr << "bad argument: " << e.what() << endl;
+        return 1;
+    }
+
+    vector<Result> results;
+    for(const Scenario& scenario: scenarios){
+        if(string(scenario.name).find(filter) != string::npos){
+            results.push_back(run_scenario(scenario, flow_orders, runs));
+        }
+    }
+
+    double timer_ns = timer_overhead_ns();
+    if(json){
+        print_json(results, timer_ns, runs);
+    }
+    else{
+        print_table(results, timer_ns);
+    }
+    return 0;
+}
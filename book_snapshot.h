@@ -0,0 +1,65 @@
+#ifndef BOOK_SNAPSHOT_H
+#define BOOK_SNAPSHOT_H
+
+// Binary book snapshot, written by OrderBook::save_snapshot and read back by OrderBook::load_snapshot
+//
+// A fixed-width little-endian file holding what a book needs to carry on after the last order it applied:
+//
+//   BookSnapshotHeader        64 bytes
+//   resting orders            order_count x 32 bytes, starting at offset 64
+//   ticker table              ticker_count x int32, ticker at position i has ticker_index i in the records
+//
+// Resting orders use the Order record of the binary order log (order_log.h) with their remaining volume. They are
+// grouped by ticker index, then side (buy, sell), then price from the lowest level up, and come in FIFO order within a
+// level, so the loader rebuilds every queue by appending records as they come. The order index is not stored, it is
+// rebuilt from the record ids.
+
+#include <cstdint>
+#include <cstring>
+#include "order_log.h" // store_le / load_le, Order record encoding
+
+const uint32_t BOOK_SNAPSHOT_VERSION = 1;
+const char BOOK_SNAPSHOT_MAGIC[8] = {'C', 'L', 'O', 'B', 'S', 'N', 'A', 'P'};
+
+struct BookSnapshotHeader {
+    char magic[8];            // BOOK_SNAPSHOT_MAGIC
+    uint32_t version;         // BOOK_SNAPSHOT_VERSION
+    uint32_t ticker_count;
+    uint64_t order_count;     // resting orders
+    uint64_t tickers_offset;  // byte offset of the ticker table
+    double tick_size;         // price increment of one tick in the records
+    int64_t pnl;              // in ticks x volume
+    uint64_t trade_seq;       // fills so far, the seq of the last trade event
+    int32_t last_id;          // id of the last order applied to the book, -1 for none
+    uint32_t reserved;
+};
+static_assert(sizeof(BookSnapshotHeader) == 64, "BookSnapshotHeader is 64 bytes on disk");
+
+inline void encode_snapshot_header(unsigned char* out, const BookSnapshotHeader& header){
+    std::memset(out, 0, sizeof(BookSnapshotHeader));
+    std::memcpy(out, BOOK_SNAPSHOT_MAGIC, sizeof(BOOK_SNAPSHOT_MAGIC));
+    store_le(out + 8, header.version);
+    store_le(out + 12, header.ticker_count);
+    store_le(out + 16, header.order_count);
+    store_le(out + 24, header.tickers_offset);
+    store_le(out + 32, header.tick_size);
+    store_le(out + 40, header.pnl);
+    store_le(out + 48, header.trade_seq);
+    store_le(out + 56, header.last_id);
+}
+
+inline BookSnapshotHeader decode_snapshot_header(const unsigned char* in){
+    BookSnapshotHeader header{};
+    std::memcpy(header.magic, in, sizeof(header.magic));
+    header.version = load_le<uint32_t>(in + 8);
+    header.ticker_count = load_le<uint32_t>(in + 12);
+    header.order_count = load_le<uint64_t>(in + 16);
+    header.tickers_offset = load_le<uint64_t>(in + 24);
+    header.tick_size = load_le<double>(in + 32);
+    header.pnl = load_le<int64_t>(in + 40);
+    header.trade_seq = load_le<uint64_t>(in + 48);
+    header.last_id = load_le<int32_t>(in + 56);
+    return header;
+}
+
+#endif
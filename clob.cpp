@@ -1,620 +1,474 @@
-#include <fstream>
 #include <iostream>
+#include <fstream>
 #include <string>
-#include <sstream> // For parsing lines
+#include <sstream>
 #include <vector>  // To store extracted data
-#include <map> // Red Black Tree for sorted keys
-#include <unordered_map>
-#include <deque> // Maintain FIFO orders
 #include <algorithm>
 #include <iomanip>
-#include <set>
-#include "csv.h" // fast cpp csv parser
+#include <limits>
+#include <memory>
+#include <thread>
+#include <exception>
+#include <chrono>
+#include "order_book.h" // matching engine
+#include "engine_server.h" // --serve
 using namespace std;
 
-struct Order {
-    int id;
-    int ticker;
-    string action; // "add" or "cancel" order
-    string type;   // "limit" or "market"
-    string side;   // "buy" or "sell"
-    double price;  // For limit orders, or 0 for market
-    int volume;
-    int cancel_target_id; // cancel order with target_id
-};
-
-class OrderBook {
-public:
-    vector<Order> load_orders_from_csv(const string& filepath, int max_id);
-    vector<Order> load_orders_from_csv_with_add_and_cancel(const string& filepath, int max_id); // with add and cancel functionality
-    void process_orders(vector<Order>& orders);
-    void process_orders_with_add_and_cancel(vector<Order>& orders); // with add and cancel functionality
-    void query_ticker(int ticker); // trading ladder format
-    void query_ticker_snapshot(int ticker); // default orderbook snapshot format
-    void query_pnl();
-    void reset();
-
-private:
-    unordered_map<int, unordered_map<string, map<double, deque<Order>>>> order_book; // order_book, sorted by: ticker > buy/sell > prices > deques (FIFO)
-    unordered_map<int, tuple<int, string,  double>> order_index; // hash map of all outstanding limit orders
-    double pnl = 0; // tracks total pnl, only matched orders realise PnL, cancelled orders do not affect PnL
-};
-
-
-int main(){
+void report_shard_scaling(const string& csv_path, size_t max_threads);
+void run_batch_queries(OrderBook& ob, const Order* first, const Order* last, bool with_add_and_cancel, const string& query_path, bool snapshot);
+
+
+int main(int argc, char* argv[]){
     int ticker, max_id;
     OrderBook ob;  // initialize matching engine class
     string filename = "C:\\Users\\admin\\Desktop\\orders-confirmed-with-cancels.csv";
     string filename_with_add_and_cancel = "C:\\Users\\admin\\Desktop\\orders-confirmed-with-cancels.csv";
 
-    while(true){
-        cout << "Please enter Ticker and max_id (or -1 -1 to quit): ";
-        cin >> ticker >> max_id;
-
-        if (ticker == -1 && max_id == -1) {
-            cout << "Exiting query..." << endl;
-            return 0;
-        }
-
-        // Data with only Add orders
-        ob.reset(); // reset order_book
-
-        vector<Order> orders = ob.load_orders_from_csv(filename, max_id); //load orders up to max_id
-        ob.process_orders(orders);
-        ob.query_pnl();
-        ob.query_ticker(ticker);
-        // ob.query_ticker_snapshot(ticker);
-
-        // // Data with Add and Cancel orders
-        // ob.reset(); // reset order_book
-
-        // vector<Order> orders = ob.load_orders_from_csv_with_add_and_cancel(filename_with_add_and_cancel, max_id); //load orders up to max_id
-        // ob.process_orders_with_add_and_cancel(orders);
-        // ob.query_pnl();
-        // ob.query_ticker(ticker);
-        // ob.query_ticker_snapshot(ticker);
-    }
-    return 0;
-}
-
-
-// using fast cpp csv parser
-vector<Order> OrderBook::load_orders_from_csv(const string& filepath, int max_id){
-    vector<Order> orders;
-    int id, ticker, volume;
-    double price;
-    string type, side;
-
-    io::CSVReader<6> in(filepath); //set CSVReader to read 6 columns from filepath
-    in.read_header(io::ignore_extra_column, "ID", "Ticker", "Type", "Side", "Price", "Volume"); //read header in csv file, ignoring any extra columns, select the 6 headers
-    
-    while(in.read_row(id, ticker, type, side, price, volume)) { // for each row, select the variables based on same order as read_header
-
-        Order order; // intialize an order struct and assign row variables to order variables
-        order.id = id;
-        order.ticker = ticker;
-        order.type = type;
-        order.side = side;
-        order.price = price;
-        order.volume = volume;
-
-        if(order.id > max_id){
-            return orders; // filter orders up to max_id
-        }
-
-        orders.push_back(order);
-    }
-    return orders;
-};
-
-
-// using fast cpp csv parser with add and cancel orders
-vector<Order> OrderBook::load_orders_from_csv_with_add_and_cancel(const string& filepath, int max_id){
-    vector<Order> orders;
-    int id, ticker, volume, cancel_target_id;
-    double price;
-    string action, type, side;
-
-    io::CSVReader<8> in(filepath); //set CSVReader to read 8 columns from filepath
-    in.read_header(io::ignore_extra_column, "ID", "Ticker", "Action", "Type", "Side", "Price", "Volume", "Cancel_Target_ID"); //read header in csv file, ignoring any extra columns, select the 6 headers
-
-    while(in.read_row(id, ticker, action, type, side, price, volume, cancel_target_id)) { // for each row, select the variables based on same order as read_header
-
-        Order order; // intialize an order struct and assign row variables to order variables
-        order.id = id;
-        order.ticker = ticker;
-        order.action = action;
-        order.type = type;
-        order.side = side;
-        order.price = price;
-        order.volume = volume;
-        order.cancel_target_id = cancel_target_id;
-
-        if(order.id > max_id){
-            return orders; // filter orders up to max_id
-        }
-
-        orders.push_back(order);
-    }
-    return orders;
-};
-
-
-// Process order_book
-void OrderBook::process_orders(vector<Order>& orders){
-    for (auto& order : orders) {// match & insert each order into book
-
-        // Market Orders
-        if(order.type == "M"){
-            if(order.side == "Buy"){ // if market order to buy, sort the current sell orders, lowest price first.
-                vector<double> sell_prices_to_delete;
-
-                for(auto& [sell_price, sell_volume_queue]: order_book[order.ticker]["Sell"]){ //iterate through all the sell prices, starting from lowest to highest
-                    if(order.volume == 0){
-                        break; // break if we filled all market buys
-                    }
-
-                    while(!sell_volume_queue.empty() && order.volume > 0){ // while current sell_volume_queue is non empty and there is still market buy volume
-
-                        int matched_volume = min(order.volume, sell_volume_queue.front().volume); // get appropriate volume to match market buy volume with current sell volume at current group of sell orders
-                        order.volume -= matched_volume; // reduce market volume
-                        sell_volume_queue.front().volume -= matched_volume; // reduce current sell volume for top most sell volume
-
-                        pnl += matched_volume * sell_price; //track pnl, lifting orders, gaining cash
-
-                        if(sell_volume_queue.front().volume == 0){ // pop front group of sell orders once its been lifted
-                            sell_volume_queue.pop_front();
-                        }
-                    }
-
-                    if(sell_volume_queue.empty()){ // add sell_price to sell_prices_to_delete if the deque is empty
-                        sell_prices_to_delete.push_back(sell_price);
-                    }
+    unique_ptr<OrderLogReader> order_log; // binary order log, replayed instead of the csv files when given
+    string stream_file; // csv file parsed and matched on two threads for every query, without keeping the orders
+    string csv_file; // csv file loaded instead of the default one
+    size_t shard_count = 0; // match the loaded orders on this many ticker shards, 0 for the single-threaded book
+    unique_ptr<TradeLogWriter> trade_writer; // trade events of every fill, written on a background thread when given
+    string serve_path; // unix socket to serve the resident book on instead of the console
+    string batch_file; // queries answered in one replay instead of reading them from the console
+    bool batch_snapshot = false;
+    string save_snapshot_path; // book snapshot written on the way out
+    string resume_path; // book snapshot to start from instead of an empty book
+    try{
+        // clob ... --trades trades.csv|trades.bin : may follow any mode below, taken out before the mode is picked
+        for(int i = 1; i + 1 < argc; ++i){
+            if(string(argv[i]) == "--trades"){
+                trade_writer = make_unique<TradeLogWriter>(argv[i + 1], ob.get_tick_size());
+                ob.publish_trades(&trade_writer->feed());
+                for(int j = i; j + 2 < argc; ++j){
+                    argv[j] = argv[j + 2];
                 }
+                argc -= 2;
+                break;
+            }
+        }
 
-                for(const auto& sell_price: sell_prices_to_delete){ // delete all sell_prices that have empty deques
-                    order_book[order.ticker]["Sell"].erase(sell_price);
+        // clob ... --serve /tmp/clob.sock : replay every order, then serve submissions and queries on a unix socket until SIGINT
+        for(int i = 1; i + 1 < argc; ++i){
+            if(string(argv[i]) == "--serve"){
+                serve_path = argv[i + 1];
+                for(int j = i; j + 2 < argc; ++j){
+                    argv[j] = argv[j + 2];
                 }
+                argc -= 2;
+                break;
             }
+        }
 
-            else if(order.side == "Sell"){
-                vector<double> buy_prices_to_delete;
-
-                for(auto it = order_book[order.ticker]["Buy"].rbegin(); it != order_book[order.ticker]["Buy"].rend(); ++it) { //reverse iterate through all the buy prices, starting from highest to lowest
-                    auto& buy_price = it->first;
-                    auto& buy_volume_queue = it->second;
-                    
-                    if(order.volume == 0){
-                        break; // break if we filled all market sells
-                    }
-
-                    while(!buy_volume_queue.empty() && order.volume > 0){ // while current buy_volume_queue is non empty and there is still market buy volume
-                        
-                        int matched_volume = min(order.volume, buy_volume_queue.front().volume); // get appropriate volume to match market buy volume with current buy volume at current group of buy orders
-                        order.volume -= matched_volume; // reduce market volume
-                        buy_volume_queue.front().volume -= matched_volume; // reduce current buy volume for top most buy volume
-
-                        pnl -= matched_volume * buy_price; //track pnl, filling orders, spending cash
-
-                        if(buy_volume_queue.front().volume == 0){ // pop front group of buy orders once its been filled
-                            buy_volume_queue.pop_front();
-                        }
-                    }
-
-                    if(buy_volume_queue.empty()){ // add buy_price to buy_prices_to_delete if the deque is empty
-                        buy_prices_to_delete.push_back(buy_price);
-                    }
+        // clob ... --batch queries.txt : answer every "ticker max_id" line in one replay, in file order, and exit
+        // clob ... --batch-snapshot queries.txt : the same in the query_ticker_snapshot format
+        for(int i = 1; i + 1 < argc; ++i){
+            if(string(argv[i]) == "--batch" || string(argv[i]) == "--batch-snapshot"){
+                batch_file = argv[i + 1];
+                batch_snapshot = string(argv[i]) == "--batch-snapshot";
+                for(int j = i; j + 2 < argc; ++j){
+                    argv[j] = argv[j + 2];
                 }
+                argc -= 2;
+                break;
+            }
+        }
 
-                for(const auto& buy_price: buy_prices_to_delete){ // delete all sell_prices that have empty deques
-                    order_book[order.ticker]["Buy"].erase(buy_price);
+        // clob ... --shards N : split the tickers across N matching threads, each query replays the loaded orders
+        for(int i = 1; i + 1 < argc; ++i){
+            if(string(argv[i]) == "--shards"){
+                shard_count = max<size_t>(stoul(argv[i + 1]), 1);
+                for(int j = i; j + 2 < argc; ++j){
+                    argv[j] = argv[j + 2];
                 }
+                argc -= 2;
+                break;
             }
         }
 
-        // Limit Orders
-        else if(order.type == "L"){
-            if(order.side == "Buy"){
-                vector<double> sell_prices_to_delete;
-
-                for(auto& [sell_price, sell_volume_queue]: order_book[order.ticker]["Sell"]){ //iterate through all the sell prices, starting from lowest to highest
-                    if(sell_price > order.price){
-                        continue; // skip sell_price if its higher than buy price for limit orders
-                    }
-                    
-                    if(order.volume == 0){
-                        break; // break if we filled all market buys
-                    }
-
-                    while(!sell_volume_queue.empty() && order.volume > 0){ // while current sell_volume_queue is non empty and there is still market buy volume
-                        
-                        int matched_volume = min(order.volume, sell_volume_queue.front().volume); // get appropriate volume to match market buy volume with current sell volume at current group of sell orders
-                        order.volume -= matched_volume; // reduce market volume
-                        sell_volume_queue.front().volume -= matched_volume; // reduce current sell volume for top most sell volume
-
-                        pnl += matched_volume * sell_price; //track pnl, lifting orders, gaining cash
-
-                        if(sell_volume_queue.front().volume == 0){ // pop front group of sell orders once its been lifted
-                            sell_volume_queue.pop_front();
-                        }
-                    }
-
-                    if(sell_volume_queue.empty()){ // add sell_price to sell_prices_to_delete if the deque is empty
-                        sell_prices_to_delete.push_back(sell_price);
+        // clob ... --save-snapshot book.snap : write the resident book to a snapshot when quitting or when the server stops
+        // clob ... --resume book.snap : start from a snapshot, only the orders after its last id are replayed
+        for(string flag: {"--save-snapshot", "--resume"}){
+            for(int i = 1; i + 1 < argc; ++i){
+                if(argv[i] == flag){
+                    (flag == "--resume" ? resume_path : save_snapshot_path) = argv[i + 1];
+                    for(int j = i; j + 2 < argc; ++j){
+                        argv[j] = argv[j + 2];
                     }
-                }
-
-                for(const auto& sell_price: sell_prices_to_delete){ // delete all sell_prices that have empty deques
-                    order_book[order.ticker]["Sell"].erase(sell_price);
+                    argc -= 2;
+                    break;
                 }
             }
+        }
 
-            else if(order.side == "Sell"){
-                vector<double> buy_prices_to_delete;
-
-                for(auto it = order_book[order.ticker]["Buy"].rbegin(); it != order_book[order.ticker]["Buy"].rend(); ++it) { //reverse iterate through all the buy prices, starting from highest to lowest
-                    auto& buy_price = it->first;
-                    auto& buy_volume_queue = it->second;
-
-                    if(buy_price < order.price){
-                        continue; // skip buy_price if its lower than sell price for limit orders
-                    }
-                    
-                    if(order.volume == 0){
-                        break; // break if we filled all market sells
-                    }
-
-                    while(!buy_volume_queue.empty() && order.volume > 0){ // while current buy_volume_queue is non empty and there is still market buy volume
-                        
-                        int matched_volume = min(order.volume, buy_volume_queue.front().volume); // get appropriate volume to match market buy volume with current buy volume at current group of buy orders
-                        order.volume -= matched_volume; // reduce market volume
-                        buy_volume_queue.front().volume -= matched_volume; // reduce current buy volume for top most buy volume
+        // clob --convert orders.csv orders.bin : write a binary order log and exit
+        if(argc == 4 && string(argv[1]) == "--convert"){
+            convert_csv_to_order_log(argv[2], argv[3], ob.get_tick_size());
+            return 0;
+        }
 
-                        pnl -= matched_volume * buy_price; //track pnl, filling orders, spending cash
+        // clob --log orders.bin : map a binary order log, its records are replayed in place
+        if(argc == 3 && string(argv[1]) == "--log"){
+            order_log = make_unique<OrderLogReader>(argv[2]);
+            ob.load_orders_from_log(*order_log);
+        }
 
-                        if(buy_volume_queue.front().volume == 0){ // pop front group of buy orders once its been filled
-                            buy_volume_queue.pop_front();
-                        }
-                    }
+        // clob --stream orders.csv : constant memory, each query re-parses the csv while matching it
+        if(argc == 3 && string(argv[1]) == "--stream"){
+            stream_file = argv[2];
+            if(!batch_file.empty() || !serve_path.empty() || !resume_path.empty()){
+                throw invalid_argument("--batch, --serve and --resume are not available with --stream");
+            }
+        }
 
-                    if(buy_volume_queue.empty()){ // add buy_price to buy_prices_to_delete if the deque is empty
-                        buy_prices_to_delete.push_back(buy_price);
-                    }
-                }
+        // clob orders.csv : load this csv, either layout, instead of the default one
+        if(argc == 2 && argv[1][0] != '-'){
+            csv_file = argv[1];
+        }
 
-                for(const auto& buy_price: buy_prices_to_delete){ // delete all sell_prices that have empty deques
-                    order_book[order.ticker]["Buy"].erase(buy_price);
-                }
+        if(shard_count > 0){
+            if(!stream_file.empty()){
+                throw invalid_argument("--stream is not available with --shards, the shards replay orders held in memory");
             }
-
-            if(order.volume > 0){ // add remaining volume to order book for limit orders
-                order_book[order.ticker][order.side][order.price].push_back(order);
+            if(trade_writer){
+                throw invalid_argument("--trades is not available with --shards");
+            }
+            if(!batch_file.empty() || !serve_path.empty() || !resume_path.empty() || !save_snapshot_path.empty()){
+                throw invalid_argument("--batch, --serve and snapshots are not available with --shards");
             }
         }
-    }
-}
-
 
-// Process order_book with add and cancel orders
-void OrderBook::process_orders_with_add_and_cancel(vector<Order>& orders){
-    for (auto& order : orders) {// match & insert each order into book
-
-        // Adding Orders
-        if(order.action == "Add"){
-            
-            // Market Orders
-            if(order.type == "M"){
-                if(order.side == "Buy"){ // if market order to buy, sort the current sell orders, lowest price first.
-                    vector<double> sell_prices_to_delete;
-
-                    for(auto& [sell_price, sell_volume_queue]: order_book[order.ticker]["Sell"]){ //iterate through all the sell prices, starting from lowest to highest
-                        if(order.volume == 0){
-                            break; // break if we filled all market buys
-                        }
-
-                        while(!sell_volume_queue.empty() && order.volume > 0){ // while current sell_volume_queue is non empty and there is still market buy volume
-
-                            int matched_volume = min(order.volume, sell_volume_queue.front().volume); // get appropriate volume to match market buy volume with current sell volume at current group of sell orders
-                            order.volume -= matched_volume; // reduce market volume
-                            sell_volume_queue.front().volume -= matched_volume; // reduce current sell volume for top most sell volume
-
-                            pnl += matched_volume * sell_price; //track pnl, lifting orders, gaining cash
-
-                            if(sell_volume_queue.front().volume == 0){ // pop front group of sell orders once its been lifted
-                                sell_volume_queue.pop_front();
-                            }
-                        }
+        if(!batch_file.empty() && !resume_path.empty()){
+            throw invalid_argument("--resume is not available with --batch, it replays from the first order");
+        }
 
-                        if(sell_volume_queue.empty()){ // add sell_price to sell_prices_to_delete if the deque is empty
-                            sell_prices_to_delete.push_back(sell_price);
-                        }
-                    }
+        // clob --scaling orders.csv [max_threads] : throughput of the sharded engine for 1..max_threads shards and exit
+        if((argc == 3 || argc == 4) && string(argv[1]) == "--scaling"){
+            report_shard_scaling(argv[2], argc == 4 ? stoul(argv[3]) : max(thread::hardware_concurrency(), 1u));
+            return 0;
+        }
+    }
+    catch(const exception& e){
+        cerr << e.what() << endl;
+        return 1;
+    }
 
-                    for(const auto& sell_price: sell_prices_to_delete){ // delete all sell_prices that have empty deques
-                        order_book[order.ticker]["Sell"].erase(sell_price);
-                    }
-                }
+    // load the whole file once, each query then moves the resident order_book forward or resumes from the nearest checkpoint
+    // the default csv is only read when no csv path, binary log, streamed csv or snapshot to resume from was given
+    vector<Order> orders;
+    if(!csv_file.empty()){
+        try{
+            orders = csv_has_add_and_cancel(csv_file) ? ob.load_orders_from_csv_with_add_and_cancel(csv_file, numeric_limits<int>::max())
+                                                       : ob.load_orders_from_csv(csv_file, numeric_limits<int>::max());
+        }
+        catch(const exception& e){
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+    else if(!order_log && stream_file.empty() && resume_path.empty()){
+        try{
+            orders = ob.load_orders_from_csv(filename, numeric_limits<int>::max()); // Data with only Add orders
+            // orders = ob.load_orders_from_csv_with_add_and_cancel(filename_with_add_and_cancel, numeric_limits<int>::max()); // Data with Add and Cancel orders
+        }
+        catch(const exception& e){
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
 
-                else if(order.side == "Sell"){
-                    vector<double> buy_prices_to_delete;
-
-                    for(auto it = order_book[order.ticker]["Buy"].rbegin(); it != order_book[order.ticker]["Buy"].rend(); ++it) { //reverse iterate through all the buy prices, starting from highest to lowest
-                        auto& buy_price = it->first;
-                        auto& buy_volume_queue = it->second;
-                        
-                        if(order.volume == 0){
-                            break; // break if we filled all market sells
-                        }
-
-                        while(!buy_volume_queue.empty() && order.volume > 0){ // while current buy_volume_queue is non empty and there is still market buy volume
-                            
-                            int matched_volume = min(order.volume, buy_volume_queue.front().volume); // get appropriate volume to match market buy volume with current buy volume at current group of buy orders
-                            order.volume -= matched_volume; // reduce market volume
-                            buy_volume_queue.front().volume -= matched_volume; // reduce current buy volume for top most buy volume
-
-                            pnl -= matched_volume * buy_price; //track pnl, filling orders, spending cash
-
-                            if(buy_volume_queue.front().volume == 0){ // pop front group of buy orders once its been filled
-                                buy_volume_queue.pop_front();
-                            }
-                        }
-
-                        if(buy_volume_queue.empty()){ // add buy_price to buy_prices_to_delete if the deque is empty
-                            buy_prices_to_delete.push_back(buy_price);
-                        }
-                    }
+    if(!resume_path.empty()){
+        try{
+            auto start = chrono::steady_clock::now();
+            ob.load_snapshot(resume_path);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            cout << "Resumed from " << resume_path << " after order id " << ob.last_order_id() << ", " << ob.stats().resting_orders
+                 << " resting orders loaded in " << fixed << setprecision(2) << ms << " ms" << endl;
+        }
+        catch(const exception& e){
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
 
-                    for(const auto& buy_price: buy_prices_to_delete){ // delete all sell_prices that have empty deques
-                        order_book[order.ticker]["Buy"].erase(buy_price);
-                    }
-                }
+    auto finish = [&]{ // flush the trade log and save the book before exiting, 1 when either could not be written
+        int status = 0;
+        if(trade_writer){
+            try{
+                trade_writer->finish();
+                cout << trade_writer->written() << " trade events written, " << trade_writer->dropped() << " dropped" << endl;
             }
-
-            // Limit Orders
-            else if(order.type == "L"){
-                if(order.side == "Buy"){
-                    vector<double> sell_prices_to_delete;
-
-                    for(auto& [sell_price, sell_volume_queue]: order_book[order.ticker]["Sell"]){ //iterate through all the sell prices, starting from lowest to highest
-                        if(sell_price > order.price){
-                            continue; // skip sell_price if its higher than buy price for limit orders
-                        }
-                        
-                        if(order.volume == 0){
-                            break; // break if we filled all market buys
-                        }
-
-                        while(!sell_volume_queue.empty() && order.volume > 0){ // while current sell_volume_queue is non empty and there is still market buy volume
-                            
-                            int matched_volume = min(order.volume, sell_volume_queue.front().volume); // get appropriate volume to match market buy volume with current sell volume at current group of sell orders
-                            order.volume -= matched_volume; // reduce market volume
-                            sell_volume_queue.front().volume -= matched_volume; // reduce current sell volume for top most sell volume
-
-                            pnl += matched_volume * sell_price; //track pnl, lifting orders, gaining cash
-
-                            if(sell_volume_queue.front().volume == 0){ // pop front group of sell orders once its been lifted
-                                sell_volume_queue.pop_front();
-                            }
-                        }
-
-                        if(sell_volume_queue.empty()){ // add sell_price to sell_prices_to_delete if the deque is empty
-                            sell_prices_to_delete.push_back(sell_price);
-                        }
-                    }
-
-                    for(const auto& sell_price: sell_prices_to_delete){ // delete all sell_prices that have empty deques
-                        order_book[order.ticker]["Sell"].erase(sell_price);
-                    }
-                }
-
-                else if(order.side == "Sell"){
-                    vector<double> buy_prices_to_delete;
-
-                    for(auto it = order_book[order.ticker]["Buy"].rbegin(); it != order_book[order.ticker]["Buy"].rend(); ++it) { //reverse iterate through all the buy prices, starting from highest to lowest
-                        auto& buy_price = it->first;
-                        auto& buy_volume_queue = it->second;
-
-                        if(buy_price < order.price){
-                            continue; // skip buy_price if its lower than sell price for limit orders
-                        }
-                        
-                        if(order.volume == 0){
-                            break; // break if we filled all market sells
-                        }
-
-                        while(!buy_volume_queue.empty() && order.volume > 0){ // while current buy_volume_queue is non empty and there is still market buy volume
-                            
-                            int matched_volume = min(order.volume, buy_volume_queue.front().volume); // get appropriate volume to match market buy volume with current buy volume at current group of buy orders
-                            order.volume -= matched_volume; // reduce market volume
-                            buy_volume_queue.front().volume -= matched_volume; // reduce current buy volume for top most buy volume
-
-                            pnl -= matched_volume * buy_price; //track pnl, filling orders, spending cash
-
-                            if(buy_volume_queue.front().volume == 0){ // pop front group of buy orders once its been filled
-                                buy_volume_queue.pop_front();
-                            }
-                        }
-
-                        if(buy_volume_queue.empty()){ // add buy_price to buy_prices_to_delete if the deque is empty
-                            buy_prices_to_delete.push_back(buy_price);
-                        }
-                    }
-
-                    for(const auto& buy_price: buy_prices_to_delete){ // delete all sell_prices that have empty deques
-                        order_book[order.ticker]["Buy"].erase(buy_price);
-                    }
-                }
-
-                if(order.volume > 0){ // add remaining volume to order book for limit orders
-                    order_book[order.ticker][order.side][order.price].push_back(order);
-                    order_index[order.id] = make_tuple(order.ticker, order.side, order.price);
-                }
+            catch(const exception& e){
+                cerr << e.what() << endl;
+                status = 1;
             }
         }
-
-        // Cancelling existing orders
-        else if(order.action == "Cancel"){
-            if(order_index.find(order.cancel_target_id) == order_index.end()){
-                cout << "Cancel_Target_Id " << order.cancel_target_id << " not found, skipping to next order..." << endl;
-                continue;
+        if(!save_snapshot_path.empty()){
+            try{
+                ob.save_snapshot(save_snapshot_path);
+                cout << "Book after order id " << ob.last_order_id() << " saved to " << save_snapshot_path << endl;
             }
-
-            auto& [ticker, side, price] = order_index[order.cancel_target_id]; //unordered_map<int, tuple<int, string,  double>> order_index;
-            auto& volume_queue = order_book[ticker][side][price];
-
-            for(auto existing_order = volume_queue.begin(); existing_order != volume_queue.end(); ++existing_order){
-                if(existing_order->id == order.cancel_target_id){
-                    volume_queue.erase(existing_order); // erase existing order from volume_queue deque
-                    break;
-                }
+            catch(const exception& e){
+                cerr << e.what() << endl;
+                status = 1;
             }
-
-            order_index.erase(order.cancel_target_id); // erase key from order_index after cancellation
-
-            if(volume_queue.empty()){
-                order_book[ticker][side].erase(price); // erase price in order_book if whole deque is empty after cancellation
+        }
+        return status;
+    };
+
+    // the loaded orders as one range, log records carry their Action so both layouts replay with cancels enabled
+    const Order* orders_begin = order_log ? order_log->begin() : orders.data();
+    const Order* orders_end = order_log ? order_log->end() : orders.data() + orders.size();
+    bool with_cancels = order_log || any_of(orders.begin(), orders.end(), [](const Order& order){ return order.action == Action::Cancel; }); // add only data matches the same either way
+
+    if(!serve_path.empty()){
+#ifdef __linux__
+        try{
+            vector<Order> missed;
+            ob.collect_missed_cancels(&missed);
+            if(!resume_path.empty()){ // the snapshot already holds the orders up to its last id
+                orders_begin = upper_bound(orders_begin, orders_end, ob.last_order_id(), [](int id, const Order& order){ return id < order.id; });
             }
+            ob.process_orders_with_add_and_cancel(orders_begin, orders_end);
+            EngineServer server(ob, serve_path);
+            cout << "Replayed " << orders_end - orders_begin << " orders (" << missed.size() << " cancels not found), serving on " << serve_path << endl;
+            server.run();
+            cout << "Stopped serving" << endl;
         }
+        catch(const exception& e){
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return finish();
+#else
+        cerr << "--serve needs Linux (epoll and unix sockets)" << endl;
+        return 1;
+#endif
     }
-}
-
 
-// Trading ladder format
-void OrderBook::query_ticker(int ticker){ // Snapshot of order book for specific ticker
-    cout << "Ticker: " << ticker << endl;
-    cout << "Bid Size | Price  | Ask Size" << endl;
-    cout << "---------+--------+---------" << endl;
-
-    set<double, greater<double>> prices; // Create a descending set of outstanding prices of orders, as there may be duplicate prices for both buys and sells
-
-    for(auto& [price, sell_volume_queue]: order_book[ticker]["Sell"]){
-        prices.insert(price);
+    if(!batch_file.empty()){
+        try{
+            run_batch_queries(ob, orders_begin, orders_end, with_cancels, batch_file, batch_snapshot);
+        }
+        catch(const exception& e){
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return finish();
     }
 
-    for(auto& [price, buy_volume_queue]: order_book[ticker]["Buy"]){
-        prices.insert(price);
+    unique_ptr<ShardedOrderBook> sharded;
+    bool sharded_cancels = false;
+    if(shard_count > 0){
+        sharded = make_unique<ShardedOrderBook>(shard_count, ob.tickers(), ob.get_tick_size());
+        sharded_cancels = with_cancels;
     }
 
-    for(double price: prices){
-        int buy_volume = 0;
-        if(order_book[ticker]["Buy"].count(price)){ // Sum buy volume if price exists on Buy side
-            for(const auto& order: order_book[ticker]["Buy"][price]){
-                buy_volume += order.volume;
+    while(true){
+        cout << "Please enter Ticker and max_id (or -1 -1 to quit): ";
+        string first;
+        cin >> first;
+        if(first == "latency"){ // per order timings so far, needs a -DCLOB_LATENCY build
+            if(sharded){
+                sharded->query_latency();
+            }
+            else{
+                ob.query_latency();
             }
+            continue;
         }
-
-        int sell_volume = 0;
-        if(order_book[ticker]["Sell"].count(price)){ // Sum sell volume if price exists on Sell side
-            for(const auto& order: order_book[ticker]["Sell"][price]){
-                sell_volume += order.volume;
+        if(first == "stats"){ // engine counters so far
+            if(sharded){
+                sharded->query_stats();
+            }
+            else{
+                ob.query_stats();
             }
+            continue;
         }
-
-        cout << setw(7); // Set constant width of Buy side column
-        if(buy_volume > 0){
-            cout << buy_volume;
+        if(!(istringstream(first) >> ticker) || !(cin >> max_id)){ // end of input or garbage quits like -1 -1
+            ticker = max_id = -1;
         }
-        else cout << " ";
 
-        cout << "  | " << setw(6) << price << " | "; // Set constant width of Price column
-        
-        if(sell_volume > 0){
-            cout << sell_volume;
+        if (ticker == -1 && max_id == -1) {
+            cout << "Exiting query..." << endl;
+            return finish();
         }
-        else cout << " ";
-        cout << endl;
-    }
-}
-
 
-// Snapshot format
-void OrderBook::query_ticker_snapshot(int ticker){ // Snapshot of order book for specific ticker
-    cout << "Printing OrderBook ----" << endl;
+        // Sharded book, replayed from the start of the csv or binary log for every query
+        if(sharded){
+            const Order* last = upper_bound(orders_begin, orders_end, max_id,
+                                            [](int id, const Order& order){ return id < order.id; }); // orders with id <= max_id
+            sharded->reset();
+            sharded->process_orders(orders_begin, last, sharded_cancels); // order_book now holds orders up to max_id
+            sharded->report_missed_cancels();
+            sharded->query_pnl();
+            sharded->query_ticker(ticker);
+            continue;
+        }
 
-    // Sells
-    for(auto it = order_book[ticker]["Sell"].rbegin(); it != order_book[ticker]["Sell"].rend(); ++it){ // Printing sells from highest to lowest
-        auto& sell_price = it->first;
-        auto& sell_volume_queue = it->second;
+        // Binary order log, records carry their Action so both layouts replay with cancels enabled
+        if(order_log){
+            ob.replay_to(order_log->begin(), order_log->end(), max_id, true); // order_book now holds orders up to max_id
+            ob.query_pnl();
+            ob.query_ticker(ticker);
+            continue;
+        }
 
-        int sell_volume = 0;
-        for(const auto& order: sell_volume_queue){
-            sell_volume += order.volume;
+        // Streamed csv, the layout (with or without Action column) is detected from its header
+        if(!stream_file.empty()){
+            try{
+                ob.stream_orders_from_csv(stream_file, max_id, csv_has_add_and_cancel(stream_file)); // order_book now holds orders up to max_id
+            }
+            catch(const exception& e){
+                cerr << e.what() << endl;
+                return 1;
+            }
+            ob.query_pnl();
+            ob.query_ticker(ticker);
+            continue;
         }
 
-        cout << "Sell " << sell_price << " " << sell_volume << endl;
-    }
+        // Data with only Add orders, or Add and Cancel orders from a csv path
+        ob.replay_to(orders, max_id, with_cancels); // order_book now holds orders up to max_id
+        ob.query_pnl();
+        ob.query_ticker(ticker);
+        // ob.query_ticker_snapshot(ticker);
 
-    // Buys
-    for(auto it = order_book[ticker]["Buy"].rbegin(); it != order_book[ticker]["Buy"].rend(); ++it){ // Printing buys from highest to lowest
-        auto& buy_price = it->first;
-        auto& buy_volume_queue = it->second;
+        // // Data with Add and Cancel orders
+        // ob.replay_to(orders, max_id, true); // order_book now holds orders up to max_id
+        // ob.query_pnl();
+        // ob.query_ticker(ticker);
+        // ob.query_ticker_snapshot(ticker);
+    }
+    return 0;
+}
 
-        int buy_volume = 0;
-        for(const auto& order: buy_volume_queue){
-            buy_volume += order.volume;
-        }
 
-        cout << "Buy " << buy_price << " " << buy_volume << endl;
+// Answer a file of "ticker max_id" queries with a single forward replay of orders
+// The queries are answered in max_id order as the replay passes each one, and printed afterwards in the order of the
+// file, so the cost is one pass over the orders plus the output instead of a replay per query. Cancels whose target
+// is not resting are reported under the query whose replay reached them.
+void run_batch_queries(OrderBook& ob, const Order* first, const Order* last, bool with_add_and_cancel, const string& query_path, bool snapshot){
+    struct Query {
+        int ticker;
+        int max_id;
+    };
+    vector<Query> queries;
+    ifstream in(query_path);
+    if(!in){
+        throw runtime_error("Can not open file \"" + query_path + "\"");
+    }
+    Query query;
+    while(in >> query.ticker >> query.max_id){
+        queries.push_back(query);
+    }
+    if(!in.eof()){
+        throw runtime_error("Query " + to_string(queries.size() + 1) + " in \"" + query_path + "\" is not a ticker and max_id pair");
     }
 
-    cout << "End" << endl;
-}
+    vector<size_t> by_max_id(queries.size());
+    for(size_t i = 0; i < by_max_id.size(); ++i){
+        by_max_id[i] = i;
+    }
+    stable_sort(by_max_id.begin(), by_max_id.end(), [&](size_t a, size_t b){ return queries[a].max_id < queries[b].max_id; });
+
+    vector<Order> missed;
+    ob.reset();
+    ob.collect_missed_cancels(&missed);
+    vector<string> answers(queries.size());
+    const Order* replayed = first; // orders before replayed are in the book
+    for(size_t i: by_max_id){
+        const Query& q = queries[i];
+        const Order* target = upper_bound(replayed, last, q.max_id, [](int id, const Order& order){ return id < order.id; }); // orders with id <= max_id
+        missed.clear();
+        if(with_add_and_cancel){
+            ob.process_orders_with_add_and_cancel(replayed, target);
+        }
+        else{
+            ob.process_orders(replayed, target);
+        }
+        replayed = target;
 
+        ostringstream answer;
+        if(!missed.empty()){
+            answer << endl; // below the query line, as the interactive loop prints them below its prompt
+        }
+        for(const Order& cancel: missed){
+            OrderBook::print_missed_cancel(cancel, answer);
+        }
+        ob.query_pnl(answer);
+        if(snapshot){
+            ob.query_ticker_snapshot(q.ticker, answer);
+        }
+        else{
+            ob.query_ticker(q.ticker, answer);
+        }
+        answers[i] = answer.str();
+    }
+    ob.collect_missed_cancels(nullptr);
 
-// Query PnL
-void OrderBook::query_pnl(){
-    cout << endl << fixed << setprecision(2) <<  "Total PnL: $" << pnl << endl << endl;
+    for(size_t i = 0; i < queries.size(); ++i){
+        cout << "Query " << i + 1 << ": " << queries[i].ticker << " " << queries[i].max_id << answers[i];
+    }
+    cout.flush();
 }
 
 
-// Reset order_book class
-void OrderBook::reset(){
-    order_book.clear(); // Clear entire order_book
-    pnl = 0; // reset PnL
+// Throughput of the sharded engine for 1..max_threads shards against the single-threaded book on the same orders
+// Every configuration is timed best of a few full replays and checked for the same PnL and missed cancels.
+void report_shard_scaling(const string& csv_path, size_t max_threads){
+    const int runs = 5;
+    OrderBook loader;
+    bool with_add_and_cancel = csv_has_add_and_cancel(csv_path);
+    vector<Order> orders = with_add_and_cancel ? loader.load_orders_from_csv_with_add_and_cancel(csv_path, numeric_limits<int>::max())
+                                               : loader.load_orders_from_csv(csv_path, numeric_limits<int>::max());
+
+    auto best_seconds = [&](auto&& replay){
+        double best = numeric_limits<double>::max();
+        for(int run = 0; run < runs; ++run){
+            auto start = chrono::steady_clock::now();
+            replay();
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    };
+    auto same_ids = [](const vector<Order>& a, const vector<Order>& b){
+        return equal(a.begin(), a.end(), b.begin(), b.end(), [](const Order& x, const Order& y){ return x.id == y.id; });
+    };
+
+    OrderBook single(loader.get_tick_size());
+    for(int32_t ticker: loader.tickers()){
+        single.register_ticker(ticker); // same ticker indices as the loaded orders
+    }
+    vector<Order> single_missed;
+    single.collect_missed_cancels(&single_missed);
+    double single_seconds = best_seconds([&]{
+        single.reset();
+        single_missed.clear();
+        if(with_add_and_cancel){
+            single.process_orders_with_add_and_cancel(orders);
+        }
+        else{
+            single.process_orders(orders);
+        }
+    });
+
+    cout << orders.size() << " orders, " << loader.tickers().size() << " tickers, " << thread::hardware_concurrency() << " hardware threads, best of " << runs << endl;
+    cout << "threads | seconds  | orders/s    | speedup | result" << endl;
+    cout << "--------+----------+-------------+---------+-------" << endl;
+    cout << fixed << "single  | " << setprecision(6) << single_seconds << " | " << setw(11) << setprecision(0) << orders.size() / single_seconds << " |   1.00x | reference" << endl;
+
+    for(size_t threads = 1; threads <= max(max_threads, (size_t)1); ++threads){
+        ShardedOrderBook sharded(threads, loader.tickers(), loader.get_tick_size());
+        vector<Order> missed;
+        double seconds = best_seconds([&]{
+            sharded.reset();
+            sharded.process_orders(orders.data(), orders.data() + orders.size(), with_add_and_cancel);
+            missed = sharded.take_missed_cancels();
+        });
+        bool identical = sharded.get_pnl() == single.get_pnl() && same_ids(missed, single_missed);
+        cout << setw(7) << threads << " | " << setprecision(6) << seconds << " | " << setw(11) << setprecision(0) << orders.size() / seconds
+             << " | " << setw(6) << setprecision(2) << single_seconds / seconds << "x | " << (identical ? "identical" : "MISMATCH") << endl;
+    }
 }
-
-
-// // using fstream and sstream
-// vector<Order> OrderBook::load_orders_from_csv(const string& filepath, int max_id){
-//     string line;
-//     ifstream file(filepath);
-//     vector<Order> orders;
-//     string cell; //each column value in each line, eg "ID", Ticker", "Side", "Type", "Price", "Volume"
-    
-//     if (!file.is_open()) {
-//         cerr << "Error opening file!" << endl;
-//     }
-
-//     getline(file, line); // Skip header row
-    
-//     while(getline(file, line)) {
-//         stringstream ss(line); // converts each line string / row into a stringstream object, can skip this and do it in a normal vector loop
-//         string cell; //each column value in each line, eg "ID", Ticker", "Side", "Type", "Price", "Volume"
-//         vector<string> row_data;
-
-//         while(getline(ss, cell, ',')) { // Now 'row_data' contains all the cell values for the current row
-//             row_data.push_back(cell);
-//         }
-
-//         Order order; // intialize an order struct
-//         order.id = stoi(row_data[0]); //convert string to int
-//         order.ticker = stoi(row_data[1]);
-//         order.type = row_data[2];
-//         order.side = row_data[3];
-//         order.price = stod(row_data[4]); //convert string to double
-//         order.volume = stoi(row_data[5]);
-
-//         if(order.id > max_id){
-//             return orders; //filter orders up to max_id
-//         }
-
-//         orders.push_back(order);
-
-//         // for (const auto& value : row_data) { // You can process or store 'row_data' as needed, e.g., print them
-//         //     cout << value << "\t";
-//         // }
-//         // cout << endl;
-//     }
-//     return orders;
-
-// };
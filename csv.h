@@ -37,6 +37,7 @@
 #include <cstring>
 #include <exception>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #ifndef CSV_IO_NO_THREAD
@@ -49,6 +50,27 @@
 #include <istream>
 #include <limits>
 #include <memory>
+#if !defined(CSV_IO_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CSV_IO_MMAP
+#endif
+#include <cstdint>
+#if !defined(CSV_IO_NO_SIMD) &&                                                \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CSV_IO_SSE2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CSV_IO_AVX2
+#endif
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace io {
 ////////////////////////////////////////////////////////////////////////////
@@ -125,6 +147,150 @@ struct line_length_limit_exceeded : base, with_file_name, with_file_line {
 };
 } // namespace error
 
+////////////////////////////////////////////////////////////////////////////
+//                           Delimiter scanning                           //
+////////////////////////////////////////////////////////////////////////////
+
+// Locating '\n' and the column separator is the inner loop of every reader.
+// The scanners below compare 16 (SSE2) or 32 (AVX2) bytes at a time against
+// two delimiter characters. AVX2 is used when the CPU supports it, which is
+// checked once at runtime, so the header still builds for a plain x86-64
+// baseline. Without SSE2 (or with CSV_IO_NO_SIMD) they fall back to byte loops.
+namespace detail {
+inline int lowest_set_bit(unsigned mask) {
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward(&i, mask);
+  return (int)i;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// Appends the offsets from begin of every byte equal to a or b
+inline std::uint32_t scan_delimiters_scalar(const char *begin, const char *end,
+                                            char a, char b,
+                                            std::uint32_t *out) {
+  std::uint32_t n = 0;
+  for (const char *p = begin; p != end; ++p)
+    if (*p == a || *p == b)
+      out[n++] = (std::uint32_t)(p - begin);
+  return n;
+}
+
+inline const char *find_delimiter_scalar(const char *begin, const char *end,
+                                         char a, char b) {
+  while (begin != end && *begin != a && *begin != b)
+    ++begin;
+  return begin;
+}
+
+#ifdef CSV_IO_SSE2
+inline std::uint32_t scan_delimiters_sse2(const char *begin, const char *end,
+                                          char a, char b, std::uint32_t *out) {
+  const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+  std::uint32_t n = 0;
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+    while (mask) {
+      out[n++] = (std::uint32_t)(p - begin) + lowest_set_bit(mask);
+      mask &= mask - 1;
+    }
+  }
+  std::uint32_t tail = scan_delimiters_scalar(p, end, a, b, out + n);
+  for (std::uint32_t i = n; i != n + tail; ++i)
+    out[i] += (std::uint32_t)(p - begin);
+  return n + tail;
+}
+
+inline const char *find_delimiter_sse2(const char *begin, const char *end,
+                                       char a, char b) {
+  const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+  for (; end - begin >= 16; begin += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+    if (mask)
+      return begin + lowest_set_bit(mask);
+  }
+  return find_delimiter_scalar(begin, end, a, b);
+}
+#endif
+
+#ifdef CSV_IO_AVX2
+__attribute__((target("avx2"))) inline std::uint32_t
+scan_delimiters_avx2(const char *begin, const char *end, char a, char b,
+                     std::uint32_t *out) {
+  const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b);
+  std::uint32_t n = 0;
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)));
+    while (mask) {
+      out[n++] = (std::uint32_t)(p - begin) + lowest_set_bit(mask);
+      mask &= mask - 1;
+    }
+  }
+  std::uint32_t tail = scan_delimiters_sse2(p, end, a, b, out + n);
+  for (std::uint32_t i = n; i != n + tail; ++i)
+    out[i] += (std::uint32_t)(p - begin);
+  return n + tail;
+}
+
+__attribute__((target("avx2"))) inline const char *
+find_delimiter_avx2(const char *begin, const char *end, char a, char b) {
+  const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b);
+  for (; end - begin >= 32; begin += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)));
+    if (mask)
+      return begin + lowest_set_bit(mask);
+  }
+  return find_delimiter_sse2(begin, end, a, b);
+}
+
+inline bool cpu_has_avx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+#endif
+
+// Writes the offset from begin of every a or b in [begin, end) to out, which
+// must have room for end - begin entries, and returns how many were found.
+inline std::uint32_t scan_delimiters(const char *begin, const char *end,
+                                     char a, char b, std::uint32_t *out) {
+#if defined(CSV_IO_AVX2)
+  if (cpu_has_avx2())
+    return scan_delimiters_avx2(begin, end, a, b, out);
+  return scan_delimiters_sse2(begin, end, a, b, out);
+#elif defined(CSV_IO_SSE2)
+  return scan_delimiters_sse2(begin, end, a, b, out);
+#else
+  return scan_delimiters_scalar(begin, end, a, b, out);
+#endif
+}
+
+// First a or b in [begin, end), or end
+inline const char *find_delimiter(const char *begin, const char *end, char a,
+                                  char b) {
+#if defined(CSV_IO_AVX2)
+  if (cpu_has_avx2())
+    return find_delimiter_avx2(begin, end, a, b);
+  return find_delimiter_sse2(begin, end, a, b);
+#elif defined(CSV_IO_SSE2)
+  return find_delimiter_sse2(begin, end, a, b);
+#else
+  return find_delimiter_scalar(begin, end, a, b);
+#endif
+}
+} // namespace detail
+
 class ByteSourceBase {
 public:
   virtual int read(char *buffer, int size) = 0;
@@ -441,10 +607,10 @@ public:
       }
     }
 
-    int line_end = data_begin;
-    while (line_end != data_end && buffer[line_end] != '\n') {
-      ++line_end;
-    }
+    int line_end =
+        detail::find_delimiter(buffer.get() + data_begin,
+                               buffer.get() + data_end, '\n', '\n') -
+        buffer.get();
 
     if (line_end - data_begin + 1 > block_len) {
       error::line_length_limit_exceeded err;
@@ -472,6 +638,230 @@ public:
   }
 };
 
+// Reads lines straight out of a memory mapped file. Unlike LineReader no block
+// is copied and no reader thread is involved, lines are returned as
+// [line_begin, line_end) ranges inside the read-only mapping and are therefore
+// not null terminated. Define CSV_IO_NO_MMAP or build on a platform without
+// mmap to read the whole file into memory with a single fread instead.
+//
+// Delimiters are located a block at a time: one vectorized pass records the
+// offset of every newline (and, after set_separator, every column separator)
+// in the block, and lines are then cut from that index.
+class MappedLineReader {
+private:
+  static const int block_len = 1 << 14;
+
+  const char *data_begin;
+  const char *data_end;
+
+  // delimiter offsets of the block starting at index_base
+  std::unique_ptr<std::uint32_t[]> index;
+  std::uint32_t index_pos;
+  std::uint32_t index_count;
+  const char *index_base;
+  const char *scan_pos; // start of the bytes not yet indexed
+  char separator;
+  std::vector<const char *> line_separators;
+
+#ifdef CSV_IO_MMAP
+  void *mapping;
+  std::size_t mapping_length;
+#endif
+  std::unique_ptr<char[]> buffer;
+
+  char file_name[error::max_file_name_length + 1];
+  unsigned file_line;
+
+  void throw_can_not_open(int errno_value) {
+    error::can_not_open_file err;
+    err.set_errno(errno_value);
+    err.set_file_name(file_name);
+    throw err;
+  }
+
+  void open_file(const char *file_name) {
+#ifdef CSV_IO_MMAP
+    int fd = ::open(file_name, O_RDONLY);
+    if (fd < 0)
+      throw_can_not_open(errno);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      int x = errno;
+      ::close(fd);
+      throw_can_not_open(x);
+    }
+    mapping_length = st.st_size;
+    if (mapping_length != 0) {
+      mapping = ::mmap(nullptr, mapping_length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED) {
+        int x = errno;
+        mapping = nullptr;
+        ::close(fd);
+        throw_can_not_open(x);
+      }
+      // Lines are consumed front to back exactly once.
+      ::madvise(mapping, mapping_length, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    init(static_cast<const char *>(mapping),
+         static_cast<const char *>(mapping) + mapping_length);
+#else
+    FILE *file = std::fopen(file_name, "rb");
+    if (file == 0)
+      throw_can_not_open(errno);
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    if (size < 0)
+      size = 0;
+    buffer = std::unique_ptr<char[]>(new char[size + 1]);
+    size = std::fread(buffer.get(), 1, size, file);
+    std::fclose(file);
+    init(buffer.get(), buffer.get() + size);
+#endif
+  }
+
+  void init(const char *begin, const char *end) {
+    file_line = 0;
+    data_begin = begin;
+    data_end = end;
+
+    // Ignore UTF-8 BOM
+    if (data_end - data_begin >= 3 && data_begin[0] == '\xEF' &&
+        data_begin[1] == '\xBB' && data_begin[2] == '\xBF')
+      data_begin += 3;
+
+    index = std::unique_ptr<std::uint32_t[]>(new std::uint32_t[block_len]);
+    separator = '\n';
+    reset_index();
+  }
+
+  void reset_index() {
+    index_pos = 0;
+    index_count = 0;
+    index_base = data_begin;
+    scan_pos = data_begin;
+  }
+
+  // next newline or separator, or data_end
+  const char *next_delimiter() {
+    while (index_pos == index_count) {
+      if (scan_pos == data_end)
+        return data_end;
+      const char *block_end =
+          data_end - scan_pos > block_len ? scan_pos + block_len : data_end;
+      index_count = detail::scan_delimiters(scan_pos, block_end, '\n',
+                                            separator, index.get());
+      index_pos = 0;
+      index_base = scan_pos;
+      scan_pos = block_end;
+    }
+    return index_base + index[index_pos++];
+  }
+
+public:
+  MappedLineReader() = delete;
+  MappedLineReader(const MappedLineReader &) = delete;
+  MappedLineReader &operator=(const MappedLineReader &) = delete;
+
+  explicit MappedLineReader(const char *file_name) {
+#ifdef CSV_IO_MMAP
+    mapping = nullptr;
+    mapping_length = 0;
+#endif
+    set_file_name(file_name);
+    open_file(file_name);
+  }
+
+  explicit MappedLineReader(const std::string &file_name)
+      : MappedLineReader(file_name.c_str()) {}
+
+  // Reads from memory that the caller keeps alive, nothing is copied.
+  MappedLineReader(const char *file_name, const char *data_begin,
+                   const char *data_end) {
+#ifdef CSV_IO_MMAP
+    mapping = nullptr;
+    mapping_length = 0;
+#endif
+    set_file_name(file_name);
+    init(data_begin, data_end);
+  }
+
+  MappedLineReader(const std::string &file_name, const char *data_begin,
+                   const char *data_end)
+      : MappedLineReader(file_name.c_str(), data_begin, data_end) {}
+
+  ~MappedLineReader() {
+#ifdef CSV_IO_MMAP
+    if (mapping != nullptr)
+      ::munmap(mapping, mapping_length);
+#endif
+  }
+
+  void set_file_name(const std::string &file_name) {
+    set_file_name(file_name.c_str());
+  }
+
+  void set_file_name(const char *file_name) {
+    if (file_name != nullptr) {
+      strncpy(this->file_name, file_name, sizeof(this->file_name) - 1);
+      this->file_name[sizeof(this->file_name) - 1] = '\0';
+    } else {
+      this->file_name[0] = '\0';
+    }
+  }
+
+  const char *get_truncated_file_name() const { return file_name; }
+
+  void set_file_line(unsigned file_line) { this->file_line = file_line; }
+
+  unsigned get_file_line() const { return file_line; }
+
+  // Also index the positions of sep, from the next line on they are available
+  // through separators()
+  void set_separator(char sep) {
+    separator = sep;
+    reset_index();
+  }
+
+  // separators inside the line last returned by next_line, in order
+  const std::vector<const char *> &separators() const {
+    return line_separators;
+  }
+
+  bool next_line(const char *&line_begin, const char *&line_end) {
+    if (data_begin == data_end)
+      return false;
+
+    ++file_line;
+
+    line_begin = data_begin;
+    line_separators.clear();
+    for (;;) {
+      const char *delimiter = next_delimiter();
+      if (delimiter == data_end) {
+        // some files are missing the newline at the end of the
+        // last line
+        line_end = data_end;
+        data_begin = data_end;
+        break;
+      }
+      if (*delimiter == '\n') {
+        line_end = delimiter;
+        data_begin = delimiter + 1;
+        break;
+      }
+      line_separators.push_back(delimiter);
+    }
+
+    // handle windows \r\n-line breaks
+    if (line_end != line_begin && *(line_end - 1) == '\r')
+      --line_end;
+
+    return true;
+  }
+};
+
 ////////////////////////////////////////////////////////////////////////////
 //                                 CSV                                    //
 ////////////////////////////////////////////////////////////////////////////
@@ -512,6 +902,14 @@ struct with_column_content {
     }
   }
 
+  void set_column_content(const char *column_begin, const char *column_end) {
+    std::size_t length = column_end - column_begin;
+    if (length > (std::size_t)max_column_content_length)
+      length = max_column_content_length;
+    std::memcpy(column_content, column_begin, length);
+    column_content[length] = '\0';
+  }
+
   char column_content[max_column_content_length + 1];
 };
 
@@ -622,6 +1020,32 @@ struct integer_underflow : base,
   }
 };
 
+struct invalid_decimal : base,
+                         with_file_name,
+                         with_file_line,
+                         with_column_name,
+                         with_column_content {
+  void format_error_message() const override {
+    std::snprintf(
+        error_message_buffer, sizeof(error_message_buffer),
+        R"(The content "%s" of column "%s" in file "%s" in line "%d" is not a decimal number.)",
+        column_content, column_name, file_name, file_line);
+  }
+};
+
+struct invalid_enum_token : base,
+                            with_file_name,
+                            with_file_line,
+                            with_column_name,
+                            with_column_content {
+  void format_error_message() const override {
+    std::snprintf(
+        error_message_buffer, sizeof(error_message_buffer),
+        R"(The content "%s" of column "%s" in file "%s" in line "%d" is not a known token.)",
+        column_content, column_name, file_name, file_line);
+  }
+};
+
 struct invalid_single_character : base,
                                   with_file_name,
                                   with_file_line,
@@ -660,10 +1084,21 @@ public:
       --str_end;
     *str_end = '\0';
   }
+
+  // range version for read-only lines, only moves the bounds
+  static void trim(const char *&str_begin, const char *&str_end) {
+    while (str_begin != str_end && is_trim_char(*str_begin, trim_char_list...))
+      ++str_begin;
+    while (str_begin != str_end &&
+           is_trim_char(*(str_end - 1), trim_char_list...))
+      --str_end;
+  }
 };
 
 struct no_comment {
   static bool is_comment(const char *) { return false; }
+
+  static bool is_comment(const char *, const char *) { return false; }
 };
 
 template <char... comment_start_char_list> struct single_line_comment {
@@ -682,6 +1117,11 @@ public:
   static bool is_comment(const char *line) {
     return is_comment_start_char(*line, comment_start_char_list...);
   }
+
+  static bool is_comment(const char *line_begin, const char *line_end) {
+    return line_begin != line_end &&
+           is_comment_start_char(*line_begin, comment_start_char_list...);
+  }
 };
 
 struct empty_line_comment {
@@ -695,6 +1135,13 @@ struct empty_line_comment {
     }
     return false;
   }
+
+  static bool is_comment(const char *line_begin, const char *line_end) {
+    while (line_begin != line_end &&
+           (*line_begin == ' ' || *line_begin == '\t'))
+      ++line_begin;
+    return line_begin == line_end;
+  }
 };
 
 template <char... comment_start_char_list>
@@ -703,6 +1150,12 @@ struct single_and_empty_line_comment {
     return single_line_comment<comment_start_char_list...>::is_comment(line) ||
            empty_line_comment::is_comment(line);
   }
+
+  static bool is_comment(const char *line_begin, const char *line_end) {
+    return single_line_comment<comment_start_char_list...>::is_comment(
+               line_begin, line_end) ||
+           empty_line_comment::is_comment(line_begin, line_end);
+  }
 };
 
 template <char sep> struct no_quote_escape {
@@ -712,6 +1165,11 @@ template <char sep> struct no_quote_escape {
     return col_begin;
   }
 
+  static const char *find_next_column_end(const char *col_begin,
+                                          const char *line_end) {
+    return detail::find_delimiter(col_begin, line_end, sep, sep);
+  }
+
   static void unescape(char *&, char *&) {}
 };
 
@@ -734,6 +1192,24 @@ template <char sep, char quote> struct double_quote_escape {
     return col_begin;
   }
 
+  static const char *find_next_column_end(const char *col_begin,
+                                          const char *line_end) {
+    while (col_begin != line_end && *col_begin != sep)
+      if (*col_begin != quote)
+        ++col_begin;
+      else {
+        do {
+          ++col_begin;
+          while (col_begin != line_end && *col_begin != quote)
+            ++col_begin;
+          if (col_begin == line_end)
+            throw error::escaped_string_not_closed();
+          ++col_begin;
+        } while (col_begin != line_end && *col_begin == quote);
+      }
+    return col_begin;
+  }
+
   static void unescape(char *&col_begin, char *&col_end) {
     if (col_end - col_begin >= 2) {
       if (*col_begin == quote && *(col_end - 1) == quote) {
@@ -783,6 +1259,30 @@ struct set_to_max_on_overflow {
   }
 };
 
+// A decimal number read as an integer count of 10^-decimals, e.g. "49.8" read
+// into fixed_point<2> has value 4980. Digits beyond the last kept decimal are
+// rounded half away from zero. No floating point is involved. A field with no
+// digit at all, such as an empty one, throws error::invalid_decimal like any
+// other malformed number, instead of reading as 0.
+template <unsigned decimals> struct fixed_point {
+  static constexpr long long power_of_ten(unsigned n) {
+    return n == 0 ? 1 : 10 * power_of_ten(n - 1);
+  }
+  static constexpr long long scale = power_of_ten(decimals);
+
+  long long value;
+};
+
+// Customisation point to read a column straight into an enum. Specialise it as
+//
+//   template <> struct enum_tokens<Side> {
+//     static bool parse(const char *begin, const char *end, Side &x);
+//   };
+//
+// where [begin, end) is the trimmed column, not null terminated. Returning
+// false throws error::invalid_enum_token.
+template <class T> struct enum_tokens;
+
 namespace detail {
 template <class quote_policy>
 void chop_next_column(char *&line, char *&col_begin, char *&col_end) {
@@ -821,6 +1321,102 @@ void parse_line(char *line, char **sorted_col,
     throw ::io::error::too_many_columns();
 }
 
+// Quote policies without quoting, whose column ends are exactly the separator
+// positions found by the delimiter scan
+template <class quote_policy> struct plain_separator {
+  static const bool value = false;
+  static const char sep = '\n';
+};
+
+template <char sep_char> struct plain_separator<no_quote_escape<sep_char>> {
+  static const bool value = true;
+  static const char sep = sep_char;
+};
+
+// Trims a column of a read-only line and stores its range. Unquoted columns
+// stay in the line, the others are copied to out to be unescaped. Returns
+// where the next copy goes.
+template <class trim_policy, class quote_policy>
+char *store_column(const char *col_begin, const char *col_end, char *out,
+                   const char *&sorted_begin, const char *&sorted_end) {
+  trim_policy::trim(col_begin, col_end);
+  if (plain_separator<quote_policy>::value) {
+    sorted_begin = col_begin;
+    sorted_end = col_end;
+    return out;
+  }
+  char *copy_begin = out;
+  char *copy_end = std::copy(col_begin, col_end, out);
+  *copy_end = '\0';
+  quote_policy::unescape(copy_begin, copy_end);
+  sorted_begin = copy_begin;
+  sorted_end = copy_end;
+  return copy_end + 1;
+}
+
+// Room for unescaped copies of the columns plus the null terminated copies
+// parse_range makes for types without a range parser, each at most the line
+// plus one terminator per column. Grows with the longest line only.
+inline char *reserve_row_buffer(std::vector<char> &buffer, const char *line,
+                                const char *line_end, std::size_t col_count) {
+  std::size_t needed = 2 * ((line_end - line) + col_count);
+  if (buffer.size() < needed)
+    buffer.resize(needed);
+  return buffer.data();
+}
+
+// Columns are delimited inside the read-only line and stored as ranges in
+// sorted_begin / sorted_end. Returns the unused part of buffer.
+template <class trim_policy, class quote_policy>
+char *parse_mapped_line(const char *line, const char *line_end,
+                        const char **sorted_begin, const char **sorted_end,
+                        const std::vector<int> &col_order,
+                        std::vector<char> &buffer) {
+  char *out = reserve_row_buffer(buffer, line, line_end, col_order.size());
+
+  for (int i : col_order) {
+    if (line == nullptr)
+      throw ::io::error::too_few_columns();
+    const char *col_begin = line;
+    const char *col_end =
+        quote_policy::find_next_column_end(col_begin, line_end);
+    line = col_end == line_end ? nullptr : col_end + 1;
+
+    if (i != -1)
+      out = store_column<trim_policy, quote_policy>(
+          col_begin, col_end, out, sorted_begin[i], sorted_end[i]);
+  }
+  if (line != nullptr)
+    throw ::io::error::too_many_columns();
+  return out;
+}
+
+// Same as parse_mapped_line for unquoted files, with the column ends taken from
+// the separator positions the line reader already found
+template <class trim_policy, class quote_policy>
+char *parse_indexed_line(const char *line, const char *line_end,
+                         const std::vector<const char *> &separators,
+                         const char **sorted_begin, const char **sorted_end,
+                         const std::vector<int> &col_order,
+                         std::vector<char> &buffer) {
+  if (separators.size() + 1 < col_order.size())
+    throw ::io::error::too_few_columns();
+  if (separators.size() + 1 > col_order.size())
+    throw ::io::error::too_many_columns();
+  char *out = reserve_row_buffer(buffer, line, line_end, col_order.size());
+
+  const char *col_begin = line;
+  for (std::size_t c = 0; c != col_order.size(); ++c) {
+    const char *col_end = c != separators.size() ? separators[c] : line_end;
+    int i = col_order[c];
+    if (i != -1)
+      out = store_column<trim_policy, quote_policy>(
+          col_begin, col_end, out, sorted_begin[i], sorted_end[i]);
+    col_begin = col_end + 1;
+  }
+  return out;
+}
+
 template <unsigned column_count, class trim_policy, class quote_policy>
 void parse_header_line(char *line, std::vector<int> &col_order,
                        const std::string *col_name,
@@ -1033,7 +1629,18 @@ template <class overflow_policy> void parse(char *col, long double &x) {
   parse_float(col, x);
 }
 
-template <class overflow_policy, class T> void parse(char *col, T &x) {
+template <class T> void parse_enum(const char *begin, const char *end, T &x) {
+  if (!enum_tokens<T>::parse(begin, end, x))
+    throw error::invalid_enum_token();
+}
+
+template <class overflow_policy, class T>
+void parse_other(char *col, T &x, std::true_type) {
+  parse_enum(col, col + std::strlen(col), x);
+}
+
+template <class overflow_policy, class T>
+void parse_other(char *col, T &x, std::false_type) {
   // Mute unused variable compiler warning
   (void)col;
   (void)x;
@@ -1042,7 +1649,311 @@ template <class overflow_policy, class T> void parse(char *col, T &x) {
   // this strange construct is used.
   static_assert(sizeof(T) != sizeof(T),
                 "Can not parse this type. Only builtin integrals, floats, "
-                "char, char*, const char* and std::string are supported");
+                "char, char*, const char*, std::string, fixed_point and "
+                "enums with an enum_tokens specialisation are supported");
+}
+
+template <class overflow_policy, class T> void parse(char *col, T &x) {
+  parse_other<overflow_policy>(col, x, std::is_enum<T>());
+}
+
+////////////////////////////////////////////////////////////////////////////
+//                      Parsing [begin, end) ranges                       //
+////////////////////////////////////////////////////////////////////////////
+
+// MappedCSVReader hands columns to these as ranges inside the read-only
+// mapping. Integers, fixed_point, enums, char and std::string are decoded in
+// place; any other type is first copied to scratch (room in the row buffer) so
+// that the null terminated parsers above can be used.
+
+template <class overflow_policy, class T>
+void parse_unsigned_integer(const char *begin, const char *end, T &x) {
+  x = 0;
+  if (end - begin <= std::numeric_limits<T>::digits10) {
+    // too few digits to overflow, skip the checks
+    for (; begin != end; ++begin) {
+      unsigned y = (unsigned char)*begin - '0';
+      if (y > 9)
+        throw error::no_digit();
+      x = 10 * x + y;
+    }
+    return;
+  }
+  for (; begin != end; ++begin) {
+    if ('0' <= *begin && *begin <= '9') {
+      T y = *begin - '0';
+      if (x > ((std::numeric_limits<T>::max)() - y) / 10) {
+        overflow_policy::on_overflow(x);
+        return;
+      }
+      x = 10 * x + y;
+    } else
+      throw error::no_digit();
+  }
+}
+
+template <class overflow_policy, class T>
+void parse_signed_integer(const char *begin, const char *end, T &x) {
+  if (begin != end && *begin == '-') {
+    ++begin;
+
+    x = 0;
+    if (end - begin <= std::numeric_limits<T>::digits10) {
+      for (; begin != end; ++begin) {
+        unsigned y = (unsigned char)*begin - '0';
+        if (y > 9)
+          throw error::no_digit();
+        x = 10 * x - y;
+      }
+      return;
+    }
+    for (; begin != end; ++begin) {
+      if ('0' <= *begin && *begin <= '9') {
+        T y = *begin - '0';
+        if (x < ((std::numeric_limits<T>::min)() + y) / 10) {
+          overflow_policy::on_underflow(x);
+          return;
+        }
+        x = 10 * x - y;
+      } else
+        throw error::no_digit();
+    }
+    return;
+  } else if (begin != end && *begin == '+')
+    ++begin;
+  parse_unsigned_integer<overflow_policy>(begin, end, x);
+}
+
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, unsigned char &x,
+                 char *&) {
+  parse_unsigned_integer<overflow_policy>(begin, end, x);
+}
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, unsigned short &x,
+                 char *&) {
+  parse_unsigned_integer<overflow_policy>(begin, end, x);
+}
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, unsigned int &x,
+                 char *&) {
+  parse_unsigned_integer<overflow_policy>(begin, end, x);
+}
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, unsigned long &x,
+                 char *&) {
+  parse_unsigned_integer<overflow_policy>(begin, end, x);
+}
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, unsigned long long &x,
+                 char *&) {
+  parse_unsigned_integer<overflow_policy>(begin, end, x);
+}
+
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, signed char &x, char *&) {
+  parse_signed_integer<overflow_policy>(begin, end, x);
+}
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, signed short &x,
+                 char *&) {
+  parse_signed_integer<overflow_policy>(begin, end, x);
+}
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, signed int &x, char *&) {
+  parse_signed_integer<overflow_policy>(begin, end, x);
+}
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, signed long &x,
+                 char *&) {
+  parse_signed_integer<overflow_policy>(begin, end, x);
+}
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, signed long long &x,
+                 char *&) {
+  parse_signed_integer<overflow_policy>(begin, end, x);
+}
+
+// digit by digit with overflow checks, for numbers too long for the fast path
+template <class overflow_policy, unsigned decimals>
+void parse_fixed_point_checked(const char *begin, const char *end,
+                               bool is_neg, fixed_point<decimals> &x) {
+  const unsigned long long limit =
+      is_neg ? 0ULL - (unsigned long long)(std::numeric_limits<long long>::min)()
+             : (unsigned long long)(std::numeric_limits<long long>::max)();
+  unsigned long long v = 0;
+  auto push_digit = [&](unsigned y) {
+    if (v > (limit - y) / 10) {
+      if (is_neg)
+        overflow_policy::on_underflow(x.value);
+      else
+        overflow_policy::on_overflow(x.value);
+      return false;
+    }
+    v = 10 * v + y;
+    return true;
+  };
+
+  for (; begin != end && *begin != '.' && *begin != ','; ++begin) {
+    unsigned y = (unsigned char)*begin - '0';
+    if (y > 9)
+      throw error::invalid_decimal();
+    if (!push_digit(y))
+      return;
+  }
+  if (begin != end)
+    ++begin; // decimal point
+
+  for (unsigned i = 0; i < decimals; ++i) {
+    unsigned y = 0;
+    if (begin != end) {
+      y = (unsigned char)*begin - '0';
+      if (y > 9)
+        throw error::invalid_decimal();
+      ++begin;
+    }
+    if (!push_digit(y))
+      return;
+  }
+
+  if (begin != end) {
+    unsigned y = (unsigned char)*begin - '0';
+    if (y > 9)
+      throw error::invalid_decimal();
+    for (const char *rest = begin + 1; rest != end; ++rest)
+      if ((unsigned)((unsigned char)*rest - '0') > 9)
+        throw error::invalid_decimal();
+    if (y >= 5) { // round half away from zero
+      if (v == limit) {
+        if (is_neg)
+          overflow_policy::on_underflow(x.value);
+        else
+          overflow_policy::on_overflow(x.value);
+        return;
+      }
+      ++v;
+    }
+  }
+
+  x.value = is_neg ? (long long)(0ULL - v) : (long long)v;
+}
+
+template <class overflow_policy, unsigned decimals>
+void parse_range(const char *begin, const char *end, fixed_point<decimals> &x,
+                 char *&) {
+  static_assert(decimals <= 18, "fixed_point keeps at most 18 decimals");
+  static const unsigned long long power_of_ten[] = {
+      1ULL,
+      10ULL,
+      100ULL,
+      1000ULL,
+      10000ULL,
+      100000ULL,
+      1000000ULL,
+      10000000ULL,
+      100000000ULL,
+      1000000000ULL,
+      10000000000ULL,
+      100000000000ULL,
+      1000000000000ULL,
+      10000000000000ULL,
+      100000000000000ULL,
+      1000000000000000ULL,
+      10000000000000000ULL,
+      100000000000000000ULL,
+      1000000000000000000ULL};
+
+  bool is_neg = false;
+  if (begin != end && *begin == '-') {
+    is_neg = true;
+    ++begin;
+  } else if (begin != end && *begin == '+')
+    ++begin;
+
+  // Up to 18 digits in total can not overflow, so the common case needs no
+  // checks and the missing decimals are added with one multiplication.
+  unsigned long long v = 0;
+  const char *col = begin;
+  for (; col != end; ++col) {
+    unsigned y = (unsigned char)*col - '0';
+    if (y > 9)
+      break;
+    v = 10 * v + y;
+  }
+  if ((col - begin) + decimals > 18) {
+    parse_fixed_point_checked<overflow_policy>(begin, end, is_neg, x);
+    return;
+  }
+
+  bool has_digit = col != begin; // an empty field, a lone sign or point is no number
+  unsigned kept = 0;
+  if (col != end) {
+    if (*col != '.' && *col != ',')
+      throw error::invalid_decimal();
+    ++col;
+    has_digit = has_digit || (col != end && (unsigned)((unsigned char)*col - '0') <= 9);
+    for (; col != end && kept != decimals; ++col, ++kept) {
+      unsigned y = (unsigned char)*col - '0';
+      if (y > 9)
+        throw error::invalid_decimal();
+      v = 10 * v + y;
+    }
+  }
+  if (!has_digit)
+    throw error::invalid_decimal();
+  v *= power_of_ten[decimals - kept];
+
+  if (col != end) {
+    unsigned y = (unsigned char)*col - '0';
+    if (y > 9)
+      throw error::invalid_decimal();
+    for (const char *rest = col + 1; rest != end; ++rest)
+      if ((unsigned)((unsigned char)*rest - '0') > 9)
+        throw error::invalid_decimal();
+    if (y >= 5) // round half away from zero
+      ++v;
+  }
+
+  x.value = is_neg ? -(long long)v : (long long)v;
+}
+
+template <class overflow_policy, unsigned decimals>
+void parse(char *col, fixed_point<decimals> &x) {
+  char *unused = nullptr;
+  parse_range<overflow_policy>(col, col + std::strlen(col), x, unused);
+}
+
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, char &x, char *&) {
+  if (end - begin != 1)
+    throw error::invalid_single_character();
+  x = *begin;
+}
+
+template <class overflow_policy>
+void parse_range(const char *begin, const char *end, std::string &x,
+                 char *&) {
+  x.assign(begin, end);
+}
+
+template <class overflow_policy, class T>
+void parse_range_other(const char *begin, const char *end, T &x, char *&,
+                       std::true_type) {
+  parse_enum(begin, end, x);
+}
+
+template <class overflow_policy, class T>
+void parse_range_other(const char *begin, const char *end, T &x,
+                       char *&scratch, std::false_type) {
+  char *col = scratch;
+  scratch = std::copy(begin, end, scratch);
+  *scratch++ = '\0';
+  parse<overflow_policy>(col, x);
+}
+
+template <class overflow_policy, class T>
+void parse_range(const char *begin, const char *end, T &x, char *&scratch) {
+  parse_range_other<overflow_policy>(begin, end, x, scratch, std::is_enum<T>());
 }
 
 } // namespace detail
@@ -1195,5 +2106,179 @@ public:
     return true;
   }
 };
+
+// Same interface as CSVReader but reads through a MappedLineReader: the file
+// is mapped instead of copied block by block through a reader thread, and lines
+// and columns are delimited inside the mapping. Integers, fixed_point, enums,
+// char and std::string are decoded straight from the mapping. Other columns are
+// copied into a small reused buffer first, so char* columns stay valid until
+// the next call to read_row.
+template <unsigned column_count, class trim_policy = trim_chars<' ', '\t'>,
+          class quote_policy = no_quote_escape<','>,
+          class overflow_policy = throw_on_overflow,
+          class comment_policy = no_comment>
+class MappedCSVReader {
+private:
+  MappedLineReader in;
+
+  // selected columns of the current row, null when a column is missing
+  const char *row_begin[column_count];
+  const char *row_end[column_count];
+  std::string column_names[column_count];
+
+  std::vector<int> col_order;
+  std::vector<char> row_buffer;
+  char *scratch; // unused part of row_buffer for the current row
+
+  template <class... ColNames>
+  void set_column_names(std::string s, ColNames... cols) {
+    column_names[column_count - sizeof...(ColNames) - 1] = std::move(s);
+    set_column_names(std::forward<ColNames>(cols)...);
+  }
+
+  void set_column_names() {}
+
+public:
+  MappedCSVReader() = delete;
+  MappedCSVReader(const MappedCSVReader &) = delete;
+  MappedCSVReader &operator=(const MappedCSVReader &);
+
+  template <class... Args>
+  explicit MappedCSVReader(Args &&... args) : in(std::forward<Args>(args)...) {
+    if (detail::plain_separator<quote_policy>::value)
+      in.set_separator(detail::plain_separator<quote_policy>::sep);
+    std::fill(row_begin, row_begin + column_count, nullptr);
+    std::fill(row_end, row_end + column_count, nullptr);
+    scratch = nullptr;
+    col_order.resize(column_count);
+    for (unsigned i = 0; i < column_count; ++i)
+      col_order[i] = i;
+    for (unsigned i = 1; i <= column_count; ++i)
+      column_names[i - 1] = "col" + std::to_string(i);
+  }
+
+  bool next_line(const char *&line_begin, const char *&line_end) {
+    return in.next_line(line_begin, line_end);
+  }
+
+  template <class... ColNames>
+  void read_header(ignore_column ignore_policy, ColNames... cols) {
+    static_assert(sizeof...(ColNames) >= column_count,
+                  "not enough column names specified");
+    static_assert(sizeof...(ColNames) <= column_count,
+                  "too many column names specified");
+    try {
+      set_column_names(std::forward<ColNames>(cols)...);
+
+      const char *line_begin, *line_end;
+      do {
+        if (!in.next_line(line_begin, line_end))
+          throw error::header_missing();
+      } while (comment_policy::is_comment(line_begin, line_end));
+
+      // the header is parsed once, from a writable copy
+      row_buffer.assign(line_begin, line_end);
+      row_buffer.push_back('\0');
+      detail::parse_header_line<column_count, trim_policy, quote_policy>(
+          row_buffer.data(), col_order, column_names, ignore_policy);
+    } catch (error::with_file_name &err) {
+      err.set_file_name(in.get_truncated_file_name());
+      throw;
+    }
+  }
+
+  template <class... ColNames> void set_header(ColNames... cols) {
+    static_assert(sizeof...(ColNames) >= column_count,
+                  "not enough column names specified");
+    static_assert(sizeof...(ColNames) <= column_count,
+                  "too many column names specified");
+    set_column_names(std::forward<ColNames>(cols)...);
+    std::fill(row_begin, row_begin + column_count, nullptr);
+    std::fill(row_end, row_end + column_count, nullptr);
+    col_order.resize(column_count);
+    for (unsigned i = 0; i < column_count; ++i)
+      col_order[i] = i;
+  }
+
+  bool has_column(const std::string &name) const {
+    return col_order.end() !=
+           std::find(col_order.begin(), col_order.end(),
+                     std::find(std::begin(column_names), std::end(column_names),
+                               name) -
+                         std::begin(column_names));
+  }
+
+  void set_file_name(const std::string &file_name) {
+    in.set_file_name(file_name);
+  }
+
+  void set_file_name(const char *file_name) { in.set_file_name(file_name); }
+
+  const char *get_truncated_file_name() const {
+    return in.get_truncated_file_name();
+  }
+
+  void set_file_line(unsigned file_line) { in.set_file_line(file_line); }
+
+  unsigned get_file_line() const { return in.get_file_line(); }
+
+private:
+  void parse_helper(std::size_t) {}
+
+  template <class T, class... ColType>
+  void parse_helper(std::size_t r, T &t, ColType &... cols) {
+    if (row_begin[r]) {
+      try {
+        try {
+          ::io::detail::parse_range<overflow_policy>(row_begin[r], row_end[r],
+                                                     t, scratch);
+        } catch (error::with_column_content &err) {
+          err.set_column_content(row_begin[r], row_end[r]);
+          throw;
+        }
+      } catch (error::with_column_name &err) {
+        err.set_column_name(column_names[r].c_str());
+        throw;
+      }
+    }
+    parse_helper(r + 1, cols...);
+  }
+
+public:
+  template <class... ColType> bool read_row(ColType &... cols) {
+    static_assert(sizeof...(ColType) >= column_count,
+                  "not enough columns specified");
+    static_assert(sizeof...(ColType) <= column_count,
+                  "too many columns specified");
+    try {
+      try {
+
+        const char *line_begin, *line_end;
+        do {
+          if (!in.next_line(line_begin, line_end))
+            return false;
+        } while (comment_policy::is_comment(line_begin, line_end));
+
+        if (detail::plain_separator<quote_policy>::value)
+          scratch = detail::parse_indexed_line<trim_policy, quote_policy>(
+              line_begin, line_end, in.separators(), row_begin, row_end,
+              col_order, row_buffer);
+        else
+          scratch = detail::parse_mapped_line<trim_policy, quote_policy>(
+              line_begin, line_end, row_begin, row_end, col_order, row_buffer);
+
+        parse_helper(0, cols...);
+      } catch (error::with_file_name &err) {
+        err.set_file_name(in.get_truncated_file_name());
+        throw;
+      }
+    } catch (error::with_file_line &err) {
+      err.set_file_line(in.get_file_line());
+      throw;
+    }
+
+    return true;
+  }
+};
 } // namespace io
 #endif
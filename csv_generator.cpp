@@ -1,95 +1,371 @@
-#include <fstream>
+// Synthetic order flow for the matching engine, as a csv file or a binary order log
+//
+// csv_generator [options] [output]      output defaults to orders-confirmed-with-cancels.csv, a path ending in .bin
+//                                       (or --binary) writes a binary order log that clob --log reads directly
+//
+// Every ticker has a mid price that random walks as its orders arrive. Limit prices sit a random distance from the
+// mid, exponentially distributed around --spread ticks, on the passive side of the mid except for --cross-rate of
+// them, which are priced through it. Cancels pick a random resting candidate in O(1) (swap and pop), so the cost of a
+// row does not grow with the file and rows go out through one large buffer, so 100M rows take about as long as the
+// disk needs to take them.
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
 #include <random>
-#include <iomanip> // set double precision
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include "order_log.h" // binary order log writer
 using namespace std;
 
-void generate_csv(string filename){
+struct GeneratorConfig {
+    string path = "orders-confirmed-with-cancels.csv";
+    bool binary = false;
+    bool add_only = false;           // ID,Ticker,Type,Side,Price,Volume layout without cancels
+    long long rows = 100000;
+    vector<int> tickers = {1131, 2211, 2313};
+    double cancel_rate = 0.5;        // Cancel vs Add rate
+    double limit_order_rate = 0.7;   // Limit vs Market Order rate
+    double cross_rate = 0.1;         // limit orders priced through the mid
+    double tick_size = 0.01;
+    double start_mid = 140.00;       // every ticker's mid starts here
+    double drift = 0.5;              // standard deviation of the mid's step per order on its ticker, in ticks
+    double spread = 20.0;            // mean distance of a limit price from the mid, in ticks
+    double band_min = 40.00;         // the mid stays inside the band, the engine keeps these prices in flat arrays
+    double band_max = 238.40;
+    int volume_min = 1;
+    int volume_max = 590;
+    bool volume_lognormal = false;   // uniform by default, lognormal has mostly small orders and a long tail
+    uint64_t seed = random_device{}();
+};
 
-    // Initialize parameters
-    int rows = 100000;
-    float cancel_rate = 0.5; // Cancel vs Add rate
-    float limit_order_rate = 0.7; // Limit vs Market Order rate
 
-    vector<int> cancel_target_ids_array; // array to store existing ids for cancels
-    vector<int> tickers = {1131, 2211, 2313};
-    vector<string> actions = {"Add", "Cancel"};
-    vector<string> types = {"Market", "Limit"};
-    vector<string> sides = {"Buy", "Sell"};
-
-    // Setup random engines
-    random_device rd;
-    mt19937 gen(rd());
-    uniform_real_distribution<> action_dis(0.0, 1.0); // for deciding Add/Cancel
-    uniform_int_distribution<> ticker_dis(0, tickers.size() - 1); // Random tickers
-    uniform_real_distribution<> type_dis(0.0, 1.0); // for deciding Market/Limit Orders
-    uniform_int_distribution<> side_dis(0, sides.size() - 1); // Random sides
-    uniform_real_distribution<double> price_dis(40.0, 238.4); // Random prices
-    uniform_int_distribution<int> volume_dis(1, 590); // Random volumes
-    
-     // Create and open the CSV file
-    ofstream outfile(filename);
-
-    // Write CSV header and set precision to 2 d.p.
-    outfile << "ID,Ticker,Action,Type,Side,Price,Volume,Cancel_Target_ID" << endl;
-    outfile << fixed << setprecision(2);
-
-    for(int id = 0; id < rows; id++){
-        cout << "ID: " << id << endl;
-
-        float add_or_cancel = action_dis(gen); // random value between 0.0 to 1.0 to determine if number is below the cutoff cancel_rate
-
-        // Cancel
-        if(add_or_cancel < cancel_rate && !cancel_target_ids_array.empty()){ // if action is a cancel and there are existing ids to cancel
-            
-            // Update random cancel_target_ids distribution with array size each loop
-            uniform_int_distribution<> cancel_target_id_dis(0, cancel_target_ids_array.size() - 1);
-
-            // Generate random target id to cancel
-            int cancel_target_id = cancel_target_ids_array[cancel_target_id_dis(gen)];
-            
-            // id, ticker, action, type, side, price, volume, cancel_target_id
-            outfile << id << ",-1,Cancel,-1,-1,-1,-1," << cancel_target_id << endl;
-            
-            // Remove target id from cancel_target_ids_array
-            cancel_target_ids_array.erase(find(cancel_target_ids_array.begin(), cancel_target_ids_array.end(), cancel_target_id));
+// Rows are formatted into one large buffer by hand, ostream and printf formatting would dominate the run time
+class RowWriter {
+public:
+    explicit RowWriter(const string& path){
+        file = fopen(path.c_str(), "w");
+        if(file == nullptr){
+            throw runtime_error("Can not create file \"" + path + "\"");
+        }
+    }
+
+    ~RowWriter(){
+        if(file != nullptr){
+            fclose(file);
+        }
+    }
+
+    void text(const char* s){
+        size_t n = strlen(s);
+        reserve(n);
+        memcpy(buffer + used, s, n);
+        used += n;
+    }
+
+    void ch(char c){
+        reserve(1);
+        buffer[used++] = c;
+    }
+
+    void integer(int64_t value){
+        reserve(24);
+        if(value < 0){
+            buffer[used++] = '-';
+            value = -value;
+        }
+        char digits[20];
+        int n = 0;
+        do{
+            digits[n++] = (char)('0' + value % 10);
+            value /= 10;
+        } while(value > 0);
+        while(n > 0){
+            buffer[used++] = digits[--n];
+        }
+    }
+
+    void fixed_point(int64_t units, int decimals, int64_t scale){ // units / scale with exactly decimals digits
+        integer(units / scale);
+        if(decimals > 0){
+            reserve(decimals + 1);
+            buffer[used++] = '.';
+            int64_t fraction = units % scale;
+            for(int64_t digit = scale / 10; digit > 0; digit /= 10){
+                buffer[used++] = (char)('0' + fraction / digit % 10);
+            }
+        }
+    }
+
+    void flush(){
+        if(used > 0 && fwrite(buffer, 1, used, file) != used){
+            throw runtime_error("Can not write output file");
+        }
+        used = 0;
+    }
+
+    void close(){
+        flush();
+        bool failed = fclose(file) != 0;
+        file = nullptr;
+        if(failed){
+            throw runtime_error("Can not write output file");
+        }
+    }
+
+private:
+    void reserve(size_t n){
+        if(used + n > sizeof(buffer)){
+            flush();
+        }
+    }
+
+    FILE* file = nullptr;
+    char buffer[1 << 20];
+    size_t used = 0;
+};
+
+
+void generate_orders(const GeneratorConfig& config){
+    mt19937_64 gen(config.seed);
+    uniform_real_distribution<double> unit_dis(0.0, 1.0); // Add/Cancel, Limit/Market and crossing cutoffs
+    uniform_int_distribution<size_t> ticker_dis(0, config.tickers.size() - 1); // Random tickers
+    normal_distribution<double> drift_dis(0.0, config.drift); // step of the mid
+    exponential_distribution<double> spread_dis(1.0 / max(config.spread, 1e-9)); // distance from the mid
+    uniform_int_distribution<int> volume_dis(config.volume_min, config.volume_max); // Random volumes
+    lognormal_distribution<double> volume_log_dis(log(sqrt((double)config.volume_min * config.volume_max)), 1.0); // median between min and max
+
+    double cancel_rate = config.add_only ? 0.0 : config.cancel_rate;
+    Price band_low = llround(config.band_min / config.tick_size);
+    Price band_high = llround(config.band_max / config.tick_size);
+    Price no_price = llround(-1.0 / config.tick_size); // -1 placeholder cell, as the engine reads it
+
+    int decimals = 0; // enough digits to print any multiple of the tick size exactly
+    while(decimals < 9 && fabs(config.tick_size * pow(10.0, decimals) - llround(config.tick_size * pow(10.0, decimals))) > 1e-9){
+        ++decimals;
+    }
+    int64_t scale = llround(pow(10.0, decimals));
+    int64_t units_per_tick = llround(config.tick_size * scale);
+
+    vector<double> mids(config.tickers.size(), config.start_mid / config.tick_size); // in ticks
+    vector<int32_t> cancel_target_ids_array; // ids of limit orders that may still rest, picked at random and removed by swap and pop
+
+    unique_ptr<RowWriter> csv;
+    unique_ptr<OrderLogWriter> log;
+    unordered_map<int, uint32_t> ticker_index; // dense index by first appearance, the same as clob --convert assigns
+    vector<int32_t> log_tickers;
+    if(config.binary){
+        log = make_unique<OrderLogWriter>(config.path, config.tick_size);
+    }
+    else{
+        csv = make_unique<RowWriter>(config.path);
+        csv->text(config.add_only ? "ID,Ticker,Type,Side,Price,Volume\n" : "ID,Ticker,Action,Type,Side,Price,Volume,Cancel_Target_ID\n");
+    }
+
+    for(long long row = 0; row < config.rows; ++row){
+        Order order{};
+        order.id = (int32_t)row;
+        order.cancel_target_id = -1;
+
+        // Cancel, if there are existing ids to cancel
+        if(unit_dis(gen) < cancel_rate && !cancel_target_ids_array.empty()){
+            size_t pick = uniform_int_distribution<size_t>(0, cancel_target_ids_array.size() - 1)(gen);
+            order.ticker = -1;
+            order.action = Action::Cancel;
+            order.type = OrderType::None;
+            order.side = Side::None;
+            order.price = no_price;
+            order.volume = -1;
+            order.cancel_target_id = cancel_target_ids_array[pick];
+            cancel_target_ids_array[pick] = cancel_target_ids_array.back(); // O(1) removal, the order of candidates does not matter
+            cancel_target_ids_array.pop_back();
         }
 
         // Add
         else{
-            // Generate random variables
-            int ticker = tickers[ticker_dis(gen)]; // random ticker
-            float limit_or_market = type_dis(gen); // random value between 0.0 to 1.0 to determine if number is below the cutoff limit_order_rate
-            string side = sides[side_dis(gen)]; // random side
-            double price = price_dis(gen); // random double price
-            int volume = volume_dis(gen); // random int volume
-
-            // Limit Order
-            // id, ticker, action, type, side, price, volume, cancel_target_id
-            if(limit_or_market < limit_order_rate){
-                
-                // Add current id to cancel_target_ids_array, only for limit orders
-                cancel_target_ids_array.push_back(id);
-
-                outfile << id << "," << ticker << ",Add,L," << side << "," << price << "," << volume << ",-1" << endl;
+            size_t t = ticker_dis(gen);
+            double& mid = mids[t];
+            mid = min(max(mid + drift_dis(gen), (double)band_low), (double)band_high); // move the mid, kept inside the band
+
+            order.ticker = config.tickers[t];
+            order.action = Action::Add;
+            order.type = unit_dis(gen) < config.limit_order_rate ? OrderType::Limit : OrderType::Market;
+            order.side = gen() & 1 ? Side::Buy : Side::Sell;
+            if(config.volume_lognormal){
+                order.volume = (int)min(max(llround(volume_log_dis(gen)), (long long)config.volume_min), (long long)config.volume_max);
+            }
+            else{
+                order.volume = volume_dis(gen);
             }
 
-            // Market Order
+            if(order.type == OrderType::Limit){
+                Price offset = llround(spread_dis(gen));
+                bool through = unit_dis(gen) < config.cross_rate; // aggressive, priced through the mid
+                bool below = (order.side == Side::Buy) != through;
+                order.price = max<Price>(llround(mid) + (below ? -offset : offset), 1);
+                cancel_target_ids_array.push_back(order.id); // Add current id to cancel_target_ids_array, only for limit orders
+            }
             else{
-                outfile << id << "," << ticker << ",Add,M," << side << ",-1," << volume << ",-1" << endl;
+                order.price = no_price;
+            }
+        }
+
+        if(log){
+            if(order.type != OrderType::None){
+                auto [it, inserted] = ticker_index.try_emplace(order.ticker, (uint32_t)log_tickers.size());
+                if(inserted){
+                    log_tickers.push_back(order.ticker);
+                }
+                order.ticker_index = it->second;
             }
+            log->append(order);
+            continue;
         }
+
+        // id, ticker, action, type, side, price, volume, cancel_target_id
+        csv->integer(order.id);
+        csv->ch(',');
+        csv->integer(order.ticker);
+        if(!config.add_only){
+            csv->text(order.action == Action::Add ? ",Add," : ",Cancel,");
+        }
+        else{
+            csv->ch(',');
+        }
+        if(order.action == Action::Cancel){
+            csv->text("-1,-1,-1,-1,");
+            csv->integer(order.cancel_target_id);
+            csv->ch('\n');
+            continue;
+        }
+        csv->text(order.type == OrderType::Limit ? "L," : "M,");
+        csv->text(order.side == Side::Buy ? "Buy," : "Sell,");
+        if(order.type == OrderType::Limit){
+            csv->fixed_point(order.price * units_per_tick, decimals, scale);
+        }
+        else{
+            csv->text("-1");
+        }
+        csv->ch(',');
+        csv->integer(order.volume);
+        csv->text(config.add_only ? "\n" : ",-1\n");
+    }
+
+    if(log){
+        log->finish(log_tickers);
+    }
+    else{
+        csv->close();
     }
-    outfile.close(); // Close the file when done
 }
 
 
-int main(){
-    string filename = "C:\\Users\\admin\\Desktop\\orders-confirmed-with-cancels.csv";
-    generate_csv(filename);
+void usage(){
+    cerr << "usage: csv_generator [options] [output.csv | output.bin]\n"
+            "  --rows N               orders to generate (100000)\n"
+            "  --tickers N            N tickers numbered from 1000, instead of 1131, 2211 and 2313\n"
+            "  --ticker-list A,B,...  these tickers\n"
+            "  --cancel-rate R        share of rows cancelling a random earlier limit order (0.5)\n"
+            "  --limit-rate R         share of adds that are limit orders, the rest are market orders (0.7)\n"
+            "  --cross-rate R         share of limit orders priced through the mid (0.1)\n"
+            "  --mid P                starting mid price of every ticker (140.00)\n"
+            "  --drift T              standard deviation of the mid's step per order, in ticks (0.5)\n"
+            "  --spread T             mean distance of limit prices from the mid, in ticks (20)\n"
+            "  --band MIN MAX         range the mid stays in (40.00 238.40)\n"
+            "  --volume MIN MAX       order volume range (1 590)\n"
+            "  --volume-dist D        uniform or lognormal (uniform)\n"
+            "  --tick T               tick size (0.01)\n"
+            "  --seed N               random seed, random by default\n"
+            "  --add-only             ID,Ticker,Type,Side,Price,Volume csv without cancels\n"
+            "  --binary               write a binary order log, also chosen by a .bin output path" << endl;
+}
+
+
+int main(int argc, char* argv[]){
+    GeneratorConfig config;
+    try{
+        for(int i = 1; i < argc; ++i){
+            string arg = argv[i];
+            auto value = [&]() -> string {
+                if(i + 1 >= argc){
+                    throw invalid_argument(arg + " needs a value");
+                }
+                return argv[++i];
+            };
 
+            if(arg == "--rows") config.rows = stoll(value());
+            else if(arg == "--tickers"){
+                int count = stoi(value());
+                config.tickers.clear();
+                for(int t = 0; t < count; ++t){
+                    config.tickers.push_back(1000 + t);
+                }
+            }
+            else if(arg == "--ticker-list"){
+                string list = value();
+                config.tickers.clear();
+                for(size_t start = 0; start <= list.size();){
+                    size_t comma = min(list.find(',', start), list.size());
+                    config.tickers.push_back(stoi(list.substr(start, comma - start)));
+                    start = comma + 1;
+                }
+            }
+            else if(arg == "--cancel-rate") config.cancel_rate = stod(value());
+            else if(arg == "--limit-rate") config.limit_order_rate = stod(value());
+            else if(arg == "--cross-rate") config.cross_rate = stod(value());
+            else if(arg == "--mid") config.start_mid = stod(value());
+            else if(arg == "--drift") config.drift = stod(value());
+            else if(arg == "--spread") config.spread = stod(value());
+            else if(arg == "--band"){
+                config.band_min = stod(value());
+                config.band_max = stod(value());
+            }
+            else if(arg == "--volume"){
+                config.volume_min = stoi(value());
+                config.volume_max = stoi(value());
+            }
+            else if(arg == "--volume-dist"){
+                string dist = value();
+                if(dist != "uniform" && dist != "lognormal"){
+                    throw invalid_argument("unknown volume distribution " + dist);
+                }
+                config.volume_lognormal = dist == "lognormal";
+            }
+            else if(arg == "--tick") config.tick_size = stod(value());
+            else if(arg == "--seed") config.seed = stoull(value());
+            else if(arg == "--add-only") config.add_only = true;
+            else if(arg == "--binary") config.binary = true;
+            else if(arg.size() > 1 && arg[0] == '-'){
+                usage();
+                return 1;
+            }
+            else config.path = arg;
+        }
+
+        if(config.path.size() >= 4 && config.path.compare(config.path.size() - 4, 4, ".bin") == 0){
+            config.binary = true;
+        }
+        if(config.rows < 0 || config.rows > numeric_limits<int32_t>::max() || config.tickers.empty() || config.tick_size <= 0 ||
+           config.volume_min < 1 || config.volume_max < config.volume_min || config.band_max < config.band_min || config.drift < 0){
+            throw invalid_argument("option out of range");
+        }
+
+        auto start = chrono::steady_clock::now();
+        generate_orders(config);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << config.rows << " orders written to " << config.path << " in " << seconds << " s (seed " << config.seed << ")" << endl;
+    }
+    catch(const exception& e){
+        cerr << e.what() << endl;
+        usage();
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
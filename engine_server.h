@@ -0,0 +1,417 @@
+#ifndef ENGINE_SERVER_H
+#define ENGINE_SERVER_H
+
+// Resident engine serving order submissions and queries over a local Unix domain socket
+//
+// One thread owns the OrderBook and multiplexes every client with epoll on nonblocking sockets, so requests are
+// applied one at a time in arrival order and need no locking. Every message is an 8 byte header followed by its
+// payload, all integers little-endian:
+//
+//   header        uint32 payload size, uint16 MessageType, uint16 reserved, 0 until a later version gives it a meaning
+//
+//   SubmitOrder   32 byte order record as in the binary order log (order_log.h), price in ticks, ticker_index ignored
+//                 -> SubmitAck  uint8 status: 0 applied, 1 cancel target not resting
+//   QueryTicker   int32 ticker, uint8 format: 0 trading ladder, 1 snapshot
+//                 -> Text       the query_pnl and query_ticker / query_ticker_snapshot output
+//   QueryPnl      empty
+//                 -> Pnl        int64 pnl in ticks x volume, float64 tick size
+//   QueryBest     int32 ticker
+//                 -> Best       bid then ask, each int64 price in ticks (NO_PRICE when empty), int64 volume, uint32 count, 4 zero bytes
+//
+// Replies come back in request order. A malformed request, including one whose reserved field is not 0, gets an Error
+// reply with a text payload, and a header announcing more than max_message_size bytes closes the connection. Orders are rejected with an Error when a limit
+// order has no price (NO_PRICE), the volume is not positive or the id is already resting. Once max_buffered bytes of
+// replies wait for a client that does not read them, its requests are neither read nor answered until they drain.
+// SIGINT or SIGTERM stops the server. They are blocked for the server's lifetime and unblocked again when it is
+// destroyed.
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "order_book.h"
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+enum class MessageType : uint16_t {
+    SubmitOrder = 1,
+    QueryTicker = 2,
+    QueryPnl = 3,
+    QueryBest = 4,
+    SubmitAck = 0x81, // replies are the request type | 0x80
+    Text = 0x82,
+    Pnl = 0x83,
+    Best = 0x84,
+    Error = 0xff,
+};
+
+const size_t MESSAGE_HEADER_SIZE = 8;
+
+
+#ifdef __linux__
+
+class EngineServer {
+public:
+    static const uint32_t max_message_size = 1 << 16;
+    static const size_t max_buffered = 1 << 20; // request bytes read ahead and reply bytes queued per client
+    static const int max_events = 64;
+
+    EngineServer(const EngineServer&) = delete;
+    EngineServer& operator=(const EngineServer&) = delete;
+
+    // book should already hold the replayed orders, it is only touched from run
+    EngineServer(OrderBook& book, const std::string& socket_path) : book(book), socket_path(socket_path) {
+        sockaddr_un address{};
+        if(socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)){
+            throw std::runtime_error("Socket path \"" + socket_path + "\" is empty or too long");
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+        listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(listener < 0){
+            fail("Can not create socket");
+        }
+        ::unlink(socket_path.c_str()); // a stale socket file from an earlier run
+        if(::bind(listener, (const sockaddr*)&address, sizeof(address)) < 0){
+            fail("Can not bind \"" + socket_path + "\"");
+        }
+        bound = true;
+        if(::listen(listener, SOMAXCONN) < 0){
+            fail("Can not listen on \"" + socket_path + "\"");
+        }
+
+        epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        if(epoll < 0){
+            fail("Can not create epoll instance");
+        }
+        watch(listener, EPOLLIN, EPOLL_CTL_ADD);
+
+        sigset_t stop_signals; // delivered through a descriptor in the epoll set instead of interrupting the loop
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGINT);
+        sigaddset(&stop_signals, SIGTERM);
+        ::sigprocmask(SIG_BLOCK, &stop_signals, &saved_mask);
+        try{
+            signals = ::signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+            if(signals < 0){
+                fail("Can not create signalfd");
+            }
+            watch(signals, EPOLLIN, EPOLL_CTL_ADD);
+        }
+        catch(...){
+            ::sigprocmask(SIG_SETMASK, &saved_mask, nullptr);
+            throw;
+        }
+        book.collect_missed_cancels(&missed);
+    }
+
+    ~EngineServer(){
+        book.collect_missed_cancels(nullptr);
+        for(auto& entry: connections){
+            ::close(entry.first);
+        }
+        for(int fd: {listener, signals, epoll}){
+            if(fd >= 0){
+                ::close(fd);
+            }
+        }
+        if(bound){
+            ::unlink(socket_path.c_str());
+        }
+        if(signals >= 0){
+            ::sigprocmask(SIG_SETMASK, &saved_mask, nullptr); // Ctrl-C works again in the host process
+        }
+    }
+
+    void run(){ // serve until SIGINT or SIGTERM
+        epoll_event events[max_events];
+        for(;;){
+            int ready = ::epoll_wait(epoll, events, max_events, -1);
+            if(ready < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                fail("epoll_wait failed");
+            }
+            for(int i = 0; i < ready; ++i){
+                int fd = events[i].data.fd;
+                if(fd == signals){
+                    signalfd_siginfo info;
+                    while(::read(signals, &info, sizeof(info)) == (ssize_t)sizeof(info)){} // consumed, or it would be delivered once the mask is restored
+                    return;
+                }
+                if(fd == listener){
+                    accept_clients();
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if(it == connections.end()){
+                    continue; // closed earlier in this batch
+                }
+                Connection& client = it->second;
+                bool open = true;
+                if(!client.finished && client.input.size() - client.consumed < max_buffered && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))){
+                    open = receive(client);
+                }
+                while(open){ // go round again while the replies drain at once and whole requests are still buffered
+                    open = answer(client) && flush_output(client);
+                    if(!client.output.empty() || !request_ready(client)){
+                        break;
+                    }
+                }
+                if(open && !(client.finished && client.output.empty())){
+                    arm(client);
+                }
+                else{
+                    close_client(fd);
+                }
+            }
+        }
+    }
+
+    size_t clients() const { return connections.size(); }
+
+private:
+    struct Connection {
+        int fd;
+        std::string input;   // request bytes, answered up to consumed
+        size_t consumed = 0; // dropped from input once they are half of it, so answering never moves the rest per read
+        std::string output;  // replies not written yet, from sent onwards, compacted like input
+        size_t sent = 0;
+        uint32_t events = EPOLLIN; // armed in epoll
+        bool finished = false; // the client shut down its side, close once the replies are written
+    };
+
+    [[noreturn]] void fail(const std::string& message){
+        throw std::runtime_error(message + ": " + std::strerror(errno));
+    }
+
+    void watch(int fd, uint32_t events, int operation){
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        if(::epoll_ctl(epoll, operation, fd, &event) < 0){
+            fail("epoll_ctl failed");
+        }
+    }
+
+    void accept_clients(){
+        for(;;){
+            int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0){
+                return; // EAGAIN once the backlog is empty, other errors only lose that client
+            }
+            connections[fd].fd = fd;
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void close_client(int fd){
+        ::epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        connections.erase(fd);
+    }
+
+    bool receive(Connection& client){ // read what is there, up to max_buffered bytes of requests, false to drop the client
+        char buffer[1 << 16];
+        while(client.input.size() - client.consumed < max_buffered){
+            ssize_t n = ::read(client.fd, buffer, sizeof(buffer));
+            if(n > 0){
+                client.input.append(buffer, (size_t)n);
+                continue;
+            }
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                break;
+            }
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n < 0){
+                return false;
+            }
+            client.finished = true; // still answer the requests it sent
+            break;
+        }
+        return true;
+    }
+
+    static bool request_ready(const Connection& client){ // a whole request is buffered
+        size_t pending = client.input.size() - client.consumed;
+        return pending >= MESSAGE_HEADER_SIZE && pending - MESSAGE_HEADER_SIZE >= load_le<uint32_t>((const unsigned char*)client.input.data() + client.consumed);
+    }
+
+    bool answer(Connection& client){ // answer whole requests until max_buffered bytes of replies are queued, false to drop the client
+        size_t offset = client.consumed;
+        while(client.input.size() - offset >= MESSAGE_HEADER_SIZE && client.output.size() - client.sent < max_buffered){
+            const unsigned char* header = (const unsigned char*)client.input.data() + offset;
+            uint32_t size = load_le<uint32_t>(header);
+            if(size > max_message_size){
+                return false;
+            }
+            if(client.input.size() - offset < MESSAGE_HEADER_SIZE + size){
+                break;
+            }
+            if(load_le<uint16_t>(header + 6) != 0){ // kept free for versioning the protocol
+                reply_error(client.output, "Reserved header field is not 0");
+            }
+            else{
+                handle((MessageType)load_le<uint16_t>(header + 4), header + MESSAGE_HEADER_SIZE, size, client.output);
+            }
+            offset += MESSAGE_HEADER_SIZE + size;
+        }
+        if(offset == client.input.size()){
+            client.input.clear();
+            offset = 0;
+        }
+        else if(offset > client.input.size() / 2){ // the leftover is the smaller half, moving it is paid for by the bytes answered
+            client.input.erase(0, offset);
+            offset = 0;
+        }
+        client.consumed = offset;
+        return true;
+    }
+
+    bool flush_output(Connection& client){ // write what the socket takes, false to drop the client
+        while(client.sent < client.output.size()){
+            ssize_t n = ::send(client.fd, client.output.data() + client.sent, client.output.size() - client.sent, MSG_NOSIGNAL); // a vanished client is an error, not SIGPIPE
+            if(n > 0){
+                client.sent += (size_t)n;
+                continue;
+            }
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                break;
+            }
+            return false;
+        }
+        if(client.sent == client.output.size()){
+            client.output.clear();
+            client.sent = 0;
+        }
+        else if(client.sent > client.output.size() / 2){ // a client that keeps reading slowly never lets it empty
+            client.output.erase(0, client.sent);
+            client.sent = 0;
+        }
+        return true;
+    }
+
+    void arm(Connection& client){ // EPOLLIN while there is room for more requests, EPOLLOUT while replies wait
+        bool reading = !client.finished && client.input.size() - client.consumed < max_buffered && client.output.size() - client.sent < max_buffered;
+        uint32_t events = (reading ? (uint32_t)EPOLLIN : 0u) | (client.output.empty() ? 0u : (uint32_t)EPOLLOUT);
+        if(events != client.events){
+            watch(client.fd, events, EPOLL_CTL_MOD);
+            client.events = events;
+        }
+    }
+
+    static void reply(std::string& output, MessageType type, const void* payload, size_t size){
+        unsigned char header[MESSAGE_HEADER_SIZE] = {};
+        store_le(header, (uint32_t)size);
+        store_le(header + 4, (uint16_t)type);
+        output.append((const char*)header, sizeof(header));
+        output.append((const char*)payload, size);
+    }
+
+    static void reply_error(std::string& output, const std::string& message){
+        reply(output, MessageType::Error, message.data(), message.size());
+    }
+
+    void handle(MessageType type, const unsigned char* payload, uint32_t size, std::string& output){
+        switch(type){
+        case MessageType::SubmitOrder: {
+            if(size != sizeof(Order)){
+                return reply_error(output, "SubmitOrder takes a 32 byte order record");
+            }
+            Order order = decode_order(payload);
+            bool add = order.action == Action::Add && order.type < OrderType::None && order.side < Side::None;
+            if(!add && order.action != Action::Cancel){
+                return reply_error(output, "Order " + std::to_string(order.id) + " has an invalid action, type or side");
+            }
+            if(add && order.type == OrderType::Limit && order.price == NO_PRICE){ // the ladders' empty sentinel
+                return reply_error(output, "Limit order " + std::to_string(order.id) + " has no price");
+            }
+            if(add && order.volume <= 0){
+                return reply_error(output, "Order " + std::to_string(order.id) + " has volume " + std::to_string(order.volume));
+            }
+            if(add && book.is_resting(order.id)){ // would take over the resting order's entry in the order index
+                return reply_error(output, "Order " + std::to_string(order.id) + " is already resting");
+            }
+            if(add){
+                order.ticker_index = book.register_ticker(order.ticker);
+            }
+            missed.clear();
+            book.process_orders_with_add_and_cancel(&order, &order + 1);
+            unsigned char status = missed.empty() ? 0 : 1;
+            return reply(output, MessageType::SubmitAck, &status, 1);
+        }
+        case MessageType::QueryTicker: {
+            if(size != 5){
+                return reply_error(output, "QueryTicker takes an int32 ticker and a uint8 format");
+            }
+            int32_t ticker = load_le<int32_t>(payload);
+            std::ostringstream text;
+            book.query_pnl(text);
+            if(payload[4] == 1){
+                book.query_ticker_snapshot(ticker, text);
+            }
+            else{
+                book.query_ticker(ticker, text);
+            }
+            std::string body = text.str();
+            return reply(output, MessageType::Text, body.data(), body.size());
+        }
+        case MessageType::QueryPnl: {
+            if(size != 0){
+                return reply_error(output, "QueryPnl takes no payload");
+            }
+            unsigned char body[16];
+            store_le(body, book.get_pnl());
+            store_le(body + 8, book.get_tick_size());
+            return reply(output, MessageType::Pnl, body, sizeof(body));
+        }
+        case MessageType::QueryBest: {
+            if(size != 4){
+                return reply_error(output, "QueryBest takes an int32 ticker");
+            }
+            int32_t ticker = load_le<int32_t>(payload);
+            unsigned char body[48] = {};
+            BookLevel levels[2] = {book.best_bid(ticker), book.best_ask(ticker)};
+            for(int i = 0; i < 2; ++i){
+                store_le(body + 24 * i, levels[i].price);
+                store_le(body + 24 * i + 8, levels[i].volume);
+                store_le(body + 24 * i + 16, levels[i].count);
+            }
+            return reply(output, MessageType::Best, body, sizeof(body));
+        }
+        default:
+            return reply_error(output, "Unknown message type " + std::to_string((unsigned)type));
+        }
+    }
+
+    OrderBook& book;
+    std::string socket_path;
+    int listener = -1;
+    int signals = -1;
+    sigset_t saved_mask; // signal mask before the constructor blocked SIGINT and SIGTERM
+    int epoll = -1;
+    bool bound = false;
+    std::unordered_map<int, Connection> connections; // by descriptor
+    std::vector<Order> missed; // cancels of the current submission whose target was not resting
+};
+
+#endif
+
+#endif
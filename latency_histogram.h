@@ -0,0 +1,121 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+// Fixed memory latency histograms and a cheap timestamp counter
+//
+// LatencyHistogram is log-linear in the style of HdrHistogram: values below 2 * sub_buckets get a bucket each and
+// every power of two range above that is split into sub_buckets equal buckets, so a recorded value is known to within
+// 1 / sub_buckets (about 3%) of itself. Recording is an index computation and an increment, no allocation.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include "price_ladder.h" // highest_bit
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LATENCY_TSC
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define LATENCY_TSC
+#endif
+
+
+// Timestamp counter ticks on x86, steady clock nanoseconds elsewhere
+inline uint64_t read_tsc(){
+#ifdef LATENCY_TSC
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline double tsc_ticks_per_ns(){ // measured once against the steady clock over a short sleep
+#ifdef LATENCY_TSC
+    static const double ratio = []{
+        auto wall_start = std::chrono::steady_clock::now();
+        uint64_t tsc_start = read_tsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        uint64_t tsc_end = read_tsc();
+        double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wall_start).count();
+        return ns > 0 ? (tsc_end - tsc_start) / ns : 1.0;
+    }();
+    return ratio;
+#else
+    return 1.0;
+#endif
+}
+
+
+class LatencyHistogram {
+public:
+    static const int sub_bits = 5;
+    static const uint64_t sub_buckets = 1ULL << sub_bits;
+    static const size_t bucket_count = (64 - sub_bits + 1) * sub_buckets; // covers every uint64_t
+
+    void record(uint64_t value){
+        ++buckets[index_of(value)];
+        ++total;
+        if(value > largest){
+            largest = value;
+        }
+    }
+
+    void merge(const LatencyHistogram& other){
+        for(size_t i = 0; i < bucket_count; ++i){
+            buckets[i] += other.buckets[i];
+        }
+        total += other.total;
+        if(other.largest > largest){
+            largest = other.largest;
+        }
+    }
+
+    void clear(){ *this = LatencyHistogram(); }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return largest; }
+
+    uint64_t percentile(double p) const { // smallest bucket bound with at least p of the samples at or below it
+        if(total == 0){
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p * total);
+        if(rank >= total){
+            rank = total - 1;
+        }
+        uint64_t seen = 0;
+        for(size_t i = 0; i < bucket_count; ++i){
+            seen += buckets[i];
+            if(seen > rank){
+                uint64_t high = highest_in(i);
+                return high < largest ? high : largest;
+            }
+        }
+        return largest;
+    }
+
+private:
+    static size_t index_of(uint64_t value){
+        if(value < 2 * sub_buckets){
+            return (size_t)value;
+        }
+        int shift = highest_bit(value) - sub_bits; // keeps sub_bits + 1 significant bits
+        return (size_t)(shift + 1) * sub_buckets + (size_t)((value >> shift) - sub_buckets);
+    }
+
+    static uint64_t highest_in(size_t index){ // largest value counted in bucket index
+        if(index < 2 * sub_buckets){
+            return index;
+        }
+        int shift = (int)(index / sub_buckets) - 1;
+        uint64_t mantissa = index % sub_buckets + sub_buckets;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    uint64_t buckets[bucket_count] = {};
+    uint64_t total = 0;
+    uint64_t largest = 0;
+};
+
+#endif
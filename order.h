@@ -0,0 +1,42 @@
+#ifndef ORDER_H
+#define ORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "price_ladder.h" // Price
+
+enum class Action : uint8_t { Add, Cancel, None };   // "Add" or "Cancel", None for unrecognised cells
+enum class OrderType : uint8_t { Limit, Market, None }; // "L" or "M", None for placeholder cells such as -1 on cancels
+enum class Side : uint8_t { Buy, Sell, None };        // "Buy" or "Sell", None for placeholder cells such as -1 on cancels
+
+// decode csv tokens [begin, end) into enums, anything unrecognised maps to None and is skipped by the engine
+// the token length picks the only candidate, so each decode is one length test and at most one compare
+inline bool token_is(const char* begin, const char* end, const char* token, size_t length){ return (size_t)(end - begin) == length && !std::memcmp(begin, token, length); }
+inline Action parse_action(const char* begin, const char* end){ return token_is(begin, end, "Add", 3) ? Action::Add : token_is(begin, end, "Cancel", 6) ? Action::Cancel : Action::None; }
+inline OrderType parse_type(const char* begin, const char* end){ return end - begin != 1 ? OrderType::None : *begin == 'L' ? OrderType::Limit : *begin == 'M' ? OrderType::Market : OrderType::None; }
+inline Side parse_side(const char* begin, const char* end){ return token_is(begin, end, "Buy", 3) ? Side::Buy : token_is(begin, end, "Sell", 4) ? Side::Sell : Side::None; }
+
+inline Action parse_action(const char* s){ return parse_action(s, s + std::strlen(s)); }
+inline OrderType parse_type(const char* s){ return parse_type(s, s + std::strlen(s)); }
+inline Side parse_side(const char* s){ return parse_side(s, s + std::strlen(s)); }
+
+struct Order { // plain trivially copyable record, 32 bytes, also the record layout of the binary order log (order_log.h)
+    int32_t id;
+    int32_t ticker;
+    Action action;    // add or cancel order
+    OrderType type;   // limit or market
+    Side side;        // buy or sell
+    uint32_t ticker_index; // dense index of ticker assigned by OrderBook::register_ticker at load time
+    Price price;      // in ticks, market orders carry their csv placeholder converted the same way (-1.00 is -100 ticks at 0.01) and never read it
+    int32_t volume;
+    int32_t cancel_target_id; // cancel order with target_id
+};
+static_assert(std::is_trivially_copyable<Order>::value && sizeof(Order) == 32, "Order should stay a compact POD record");
+static_assert(offsetof(Order, id) == 0 && offsetof(Order, ticker) == 4 && offsetof(Order, action) == 8 &&
+              offsetof(Order, type) == 9 && offsetof(Order, side) == 10 && offsetof(Order, ticker_index) == 12 &&
+              offsetof(Order, price) == 16 && offsetof(Order, volume) == 24 && offsetof(Order, cancel_target_id) == 28,
+              "Order layout is the on-disk record layout of the binary order log");
+
+#endif
@@ -0,0 +1,1232 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sstream> // For parsing lines
+#include <vector>  // To store extracted data
+#include <unordered_map>
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <thread>
+#include <exception>
+#include <cstdio>
+#ifdef __linux__
+#include <pthread.h> // pin shard workers to cores
+#include <sched.h>
+#endif
+#include "order_book.h"
+using namespace std;
+
+
+// using fast cpp csv parser
+// decode each row of a csv file with only Add orders and pass it to on_order, which returns false to stop reading
+// only reads the book's tick size, so it can run on a parser thread while the book is being matched
+template <class OnOrder>
+void OrderBook::for_each_csv_order(const string& filepath, OnOrder&& on_order) const {
+    Order order{};
+    CsvPrice price;
+
+    io::MappedCSVReader<6> in(filepath); //set CSVReader to read 6 columns from filepath, delimited straight out of the memory mapped file
+    in.read_header(io::ignore_extra_column, "ID", "Ticker", "Type", "Side", "Price", "Volume"); //read header in csv file, ignoring any extra columns, select the 6 headers
+
+    while(in.read_row(order.id, order.ticker, order.type, order.side, price, order.volume)){ // for each row, select the variables based on same order as read_header
+        order.ticker_index = 0; // assigned by the caller, register_ticker is not safe off the matching thread
+        order.action = Action::Add; // add only data
+        order.price = to_ticks(price); // store price as integer ticks
+        order.cancel_target_id = -1;
+
+        if(!on_order(order)){
+            return;
+        }
+    }
+}
+
+
+// using fast cpp csv parser with add and cancel orders
+template <class OnOrder>
+void OrderBook::for_each_csv_order_with_add_and_cancel(const string& filepath, OnOrder&& on_order) const {
+    Order order{};
+    CsvPrice price;
+
+    io::MappedCSVReader<8> in(filepath); //set CSVReader to read 8 columns from filepath, delimited straight out of the memory mapped file
+    in.read_header(io::ignore_extra_column, "ID", "Ticker", "Action", "Type", "Side", "Price", "Volume", "Cancel_Target_ID"); //read header in csv file, ignoring any extra columns, select the 6 headers
+
+    while(in.read_row(order.id, order.ticker, order.action, order.type, order.side, price, order.volume, order.cancel_target_id)){ // for each row, select the variables based on same order as read_header
+        order.ticker_index = 0;
+        order.price = to_ticks(price); // store price as integer ticks
+
+        if(!on_order(order)){
+            return;
+        }
+    }
+}
+
+
+vector<Order> OrderBook::load_orders_from_csv(const string& filepath, int max_id){
+    vector<Order> orders;
+    for_each_csv_order(filepath, [&](Order& order){
+        if(order.id > max_id){
+            return false; // filter orders up to max_id
+        }
+        if(order.type != OrderType::None){
+            order.ticker_index = register_ticker(order.ticker); // resolve the ticker once here instead of on every match
+        }
+        orders.push_back(order);
+        return true;
+    });
+    return orders;
+};
+
+
+vector<Order> OrderBook::load_orders_from_csv_with_add_and_cancel(const string& filepath, int max_id){
+    vector<Order> orders;
+    for_each_csv_order_with_add_and_cancel(filepath, [&](Order& order){
+        if(order.id > max_id){
+            return false; // filter orders up to max_id
+        }
+        if(order.type != OrderType::None){
+            order.ticker_index = register_ticker(order.ticker); // resolve the ticker once here instead of on every match
+        }
+        orders.push_back(order);
+        return true;
+    });
+    return orders;
+};
+
+
+// Rebuild the book from a csv file up to max_id without keeping the orders
+// A parser thread decodes rows into a bounded ring while this thread matches them in batches straight out of the ring,
+// so memory stays constant and parsing overlaps matching. The book is reset first, nothing is left to replay from.
+void OrderBook::stream_orders_from_csv(const string& filepath, int max_id, bool with_add_and_cancel){
+    reset();
+
+    SpscRing<Order> ring(stream_ring_capacity);
+    exception_ptr parse_error;
+    thread parser([&]{
+        try{
+            auto push = [&](const Order& order){
+                if(order.id > max_id){
+                    return false; // filter orders up to max_id
+                }
+                Order* slot;
+                while((slot = ring.claim()) == nullptr){
+                    this_thread::yield(); // ring full, let the matcher catch up
+                }
+                *slot = order;
+                ring.commit();
+                return true;
+            };
+            if(with_add_and_cancel){
+                for_each_csv_order_with_add_and_cancel(filepath, push);
+            }
+            else{
+                for_each_csv_order(filepath, push);
+            }
+        }
+        catch(...){
+            parse_error = current_exception();
+        }
+        ring.close();
+    });
+
+    for(;;){
+        Order* batch;
+        size_t n = ring.peek(batch);
+        if(n == 0){
+            if(ring.drained()){
+                break;
+            }
+            this_thread::yield(); // ring empty, let the parser catch up
+            continue;
+        }
+
+        for(size_t i = 0; i < n; ++i){ // tickers are registered on this thread, the parser never touches the book
+            if(batch[i].type != OrderType::None){
+                batch[i].ticker_index = register_ticker(batch[i].ticker);
+            }
+        }
+        if(with_add_and_cancel){
+            process_orders_with_add_and_cancel(batch, batch + n);
+        }
+        else{
+            process_orders(batch, batch + n);
+        }
+        ring.release(n);
+    }
+
+    parser.join();
+    if(parse_error){
+        rethrow_exception(parse_error);
+    }
+}
+
+
+// True when a csv order file has the Action / Cancel_Target_ID layout
+bool csv_has_add_and_cancel(const string& csv_path){
+    string header;
+    ifstream csv(csv_path);
+    getline(csv, header);
+    return header.find("Action") != string::npos;
+}
+
+
+// Process order_book
+void OrderBook::process_orders(const Order* first, const Order* last){
+    for (const Order* it = first; it != last; ++it) {// match & insert each order into book
+        Order order = *it; // working copy, the remaining volume is consumed while matching
+        uint64_t start = latency_start();
+        add_order(order);
+        latency_stop(add_kind(*it, order), start);
+    }
+    if(first != last){
+        last_id = last[-1].id;
+    }
+
+    if(trade_feed != nullptr){
+        trade_feed->flush(); // the reader sees this batch's trades without waiting for more fills
+    }
+}
+
+
+// Process order_book with add and cancel orders
+void OrderBook::process_orders_with_add_and_cancel(const Order* first, const Order* last){
+    for (const Order* it = first; it != last; ++it) {// match & insert each order into book
+        Order order = *it;
+        uint64_t start = latency_start();
+
+        if(order.action == Action::Add){ // Adding Orders
+            add_order(order);
+            latency_stop(add_kind(*it, order), start);
+        }
+        else if(order.action == Action::Cancel){ // Cancelling existing orders
+            bool found = cancel_order(order);
+            latency_stop(found ? OrderOp::CancelHit : OrderOp::CancelMiss, start);
+        }
+    }
+    if(first != last){
+        last_id = last[-1].id;
+    }
+
+    if(trade_feed != nullptr){
+        trade_feed->flush();
+    }
+}
+
+
+// Match an incoming market or limit order, then rest what is left of a limit order
+void OrderBook::add_order(Order& order){
+    if(order.type == OrderType::None){
+        ++counters.skipped_orders;
+        return; // placeholder rows are skipped
+    }
+
+    if(order.side == Side::Buy){ // buys lift the sells, lowest price first
+        match<Side::Buy>(order);
+    }
+    else if(order.side == Side::Sell){ // sells hit the buys, highest price first
+        match<Side::Sell>(order);
+    }
+    else{
+        ++counters.skipped_orders;
+        return;
+    }
+
+    if(order.type == OrderType::Market){
+        ++counters.market_orders;
+        return; // market orders are IOC
+    }
+    ++counters.limit_orders;
+
+    if(order.volume > 0){ // add remaining volume to order book for limit orders
+        PriceLevel& level = side_ladder(order.ticker_index, order.side)[order.price];
+        if(level.empty()){ // the level was just created
+            ++counters.levels_created;
+            const TickerBook& book = books[order.ticker_index];
+            uint32_t levels = (uint32_t)(book.sides[0].size() + book.sides[1].size());
+            peak_levels[order.ticker_index] = max(peak_levels[order.ticker_index], levels);
+        }
+        order_index.insert(order.id, pool.push_back(level, order));
+        counters.peak_resting_orders = max<uint64_t>(counters.peak_resting_orders, order_index.size());
+    }
+}
+
+
+// Sweep the opposite side of the book from its best level until order is filled or the next level no longer crosses
+// side is the side of the incoming order, market orders sweep with an unbounded limit. Levels emptied by the sweep are
+// erased as it leaves them, and the next best level comes from the ladder's cached best price, so nothing is allocated.
+template <Side side>
+void OrderBook::match(Order& order){
+    constexpr bool buy = side == Side::Buy;
+    auto& ladder = side_ladder(order.ticker_index, buy ? Side::Sell : Side::Buy);
+    Price limit = order.type == OrderType::Market ? (buy ? numeric_limits<Price>::max() : numeric_limits<Price>::min()) : order.price;
+    uint64_t swept = 0; // levels traded against
+
+    while(order.volume > 0){
+        Price price = buy ? ladder.lowest() : ladder.highest();
+        if(price == NO_PRICE || (buy ? price > limit : price < limit)){
+            break; // book empty or the best level does not cross
+        }
+
+        PriceLevel& level = *ladder.find(price);
+        int64_t filled = fill_level(level, order, price);
+        ++swept;
+        if(buy){
+            pnl += filled * price; //track pnl, lifting orders, gaining cash
+        }
+        else{
+            pnl -= filled * price; //track pnl, filling orders, spending cash
+        }
+
+        if(level.empty()){
+            ladder.erase(price); // delete the price level once its whole queue is filled
+            ++counters.levels_erased;
+        }
+    }
+
+    if(swept > 0){
+        ++counters.aggressive_orders;
+        counters.levels_swept += swept;
+        counters.max_levels_swept = max(counters.max_levels_swept, swept);
+    }
+}
+
+
+// Remove a resting order by id, reported as not found when it was filled, cancelled or never added
+bool OrderBook::cancel_order(const Order& order){
+    ++counters.cancels;
+    uint32_t handle = order_index.find(order.cancel_target_id); // node of the resting order, which knows its own ticker, side and price
+    if(handle == OrderIndex::none){
+        ++counters.missed_cancels;
+        if(missed_cancels != nullptr){
+            missed_cancels->push_back(order);
+        }
+        else{
+            print_missed_cancel(order);
+        }
+        return false;
+    }
+
+    const Order& existing_order = pool[handle].order;
+    Price price = existing_order.price;
+    auto& ladder = side_ladder(existing_order.ticker_index, existing_order.side);
+    auto& volume_queue = *ladder.find(price);
+
+    pool.erase(volume_queue, handle); // unlink existing order from the volume_queue, O(1) without shifting its neighbours
+    order_index.erase(order.cancel_target_id); // erase key from order_index after cancellation
+
+    if(volume_queue.empty()){
+        ladder.erase(price); // erase price in order_book if whole queue is empty after cancellation
+        ++counters.levels_erased;
+    }
+    return true;
+}
+
+
+// Dense ticker index, new tickers get an empty book with the configured price band
+uint32_t OrderBook::register_ticker(int ticker){
+    auto [it, inserted] = ticker_registry.try_emplace(ticker, (uint32_t)books.size());
+    if(inserted){
+        books.emplace_back(band_low, band_high);
+        ticker_list.push_back(ticker);
+        peak_levels.push_back(0);
+    }
+    return it->second;
+}
+
+
+// Fill order against the FIFO of one price level, oldest first, and return the volume filled
+// When the order outsizes the level's total the whole level is taken in one pass, every resting order fills completely
+// and no per order volume arithmetic is needed. Otherwise the level outlasts the order and is never emptied here.
+int OrderBook::fill_level(PriceLevel& level, Order& order, Price price){
+    if(order.volume >= level.volume){
+        int filled = (int)level.volume;
+        counters.fills += level.count;
+        while(!level.empty()){
+            emit_trade(order, pool[level.head].order, price, pool[level.head].order.volume);
+            pop_front(level);
+        }
+        order.volume -= filled;
+        return filled;
+    }
+
+    int filled = 0;
+    while(order.volume > 0){
+        Order& resting = pool[level.head].order;
+        int matched_volume = min(order.volume, resting.volume); // get appropriate volume to match with the front resting order
+        order.volume -= matched_volume;
+        resting.volume -= matched_volume;
+        level.volume -= matched_volume;
+        filled += matched_volume;
+        ++counters.fills;
+        emit_trade(order, resting, price, matched_volume);
+
+        if(resting.volume == 0){ // pop front order once its been filled
+            pop_front(level);
+        }
+    }
+    return filled;
+}
+
+
+// Remove the filled order at the front of a price level
+void OrderBook::pop_front(PriceLevel& level){
+    order_index.erase(pool[level.head].order.id); // filled orders can no longer be cancelled
+    pool.erase(level, level.head);
+}
+
+
+// Trading ladder format
+void OrderBook::query_ticker(int ticker, ostream& out) const { // Snapshot of order book for specific ticker
+    out << fixed << setprecision(2) << "Ticker: " << ticker << endl;
+    out << "Bid Size | Price  | Ask Size" << endl;
+    out << "---------+--------+---------" << endl;
+
+    const TickerBook* book = find_book(ticker);
+    if(book == nullptr){
+        return; // never seen, an empty ladder
+    }
+    const auto& sells = book->sides[(size_t)Side::Sell];
+    const auto& buys = book->sides[(size_t)Side::Buy];
+
+    // walk both sides from the highest price down at once, a price present on both sides is printed on one row
+    Price buy_price = buys.highest();
+    Price sell_price = sells.highest();
+    while(buy_price != NO_PRICE || sell_price != NO_PRICE){
+        Price price = max(buy_price, sell_price); // NO_PRICE sorts below every price
+        int64_t buy_volume = 0;
+        if(buy_price == price){ // level totals, no need to visit the orders
+            buy_volume = buys.find(price)->volume;
+            buy_price = buys.next_lower(price);
+        }
+
+        int64_t sell_volume = 0;
+        if(sell_price == price){
+            sell_volume = sells.find(price)->volume;
+            sell_price = sells.next_lower(price);
+        }
+
+        out << setw(7); // Set constant width of Buy side column
+        if(buy_volume > 0){
+            out << buy_volume;
+        }
+        else out << " ";
+
+        out << "  | " << setw(6) << to_price(price) << " | "; // Set constant width of Price column
+        
+        if(sell_volume > 0){
+            out << sell_volume;
+        }
+        else out << " ";
+        out << endl;
+    }
+}
+
+
+// Snapshot format
+void OrderBook::query_ticker_snapshot(int ticker, ostream& out) const { // Snapshot of order book for specific ticker
+    out << fixed << setprecision(2) << "Printing OrderBook ----" << endl;
+    const TickerBook* book = find_book(ticker);
+    if(book == nullptr){
+        out << "End" << endl; // never seen, an empty book
+        return;
+    }
+
+    // Sells
+    const auto& sells = book->sides[(size_t)Side::Sell];
+    for(Price sell_price = sells.highest(); sell_price != NO_PRICE; sell_price = sells.next_lower(sell_price)){ // Printing sells from highest to lowest
+        int64_t sell_volume = sells.find(sell_price)->volume; // maintained on add, fill and cancel
+        out << "Sell " << to_price(sell_price) << " " << sell_volume << endl;
+    }
+
+    // Buys
+    const auto& buys = book->sides[(size_t)Side::Buy];
+    for(Price buy_price = buys.highest(); buy_price != NO_PRICE; buy_price = buys.next_lower(buy_price)){ // Printing buys from highest to lowest
+        int64_t buy_volume = buys.find(buy_price)->volume; // maintained on add, fill and cancel
+        out << "Buy " << to_price(buy_price) << " " << buy_volume << endl;
+    }
+
+    out << "End" << endl;
+}
+
+
+// Top of book, O(1) with the cached best prices and level totals
+BookLevel OrderBook::best_bid(int ticker) const {
+    const TickerBook* book = find_book(ticker);
+    if(book == nullptr){
+        return BookLevel();
+    }
+    const auto& buys = book->sides[(size_t)Side::Buy];
+    return level_at(buys, buys.highest());
+}
+
+
+BookLevel OrderBook::best_ask(int ticker) const {
+    const TickerBook* book = find_book(ticker);
+    if(book == nullptr){
+        return BookLevel();
+    }
+    const auto& sells = book->sides[(size_t)Side::Sell];
+    return level_at(sells, sells.lowest());
+}
+
+
+// Aggregated depth, bids from the highest price down and asks from the lowest up, O(levels) with no allocation
+BookDepth OrderBook::depth(int ticker, size_t levels, BookLevel* bids, BookLevel* asks) const {
+    BookDepth written;
+    const TickerBook* book = find_book(ticker);
+    if(book == nullptr){
+        return written;
+    }
+
+    const auto& buys = book->sides[(size_t)Side::Buy];
+    for(Price price = buys.highest(); price != NO_PRICE && written.bids < levels; price = buys.next_lower(price)){
+        bids[written.bids++] = level_at(buys, price);
+    }
+
+    const auto& sells = book->sides[(size_t)Side::Sell];
+    for(Price price = sells.lowest(); price != NO_PRICE && written.asks < levels; price = sells.next_higher(price)){
+        asks[written.asks++] = level_at(sells, price);
+    }
+    return written;
+}
+
+
+const TickerBook* OrderBook::find_book(int ticker) const {
+    auto it = ticker_registry.find(ticker);
+    return it != ticker_registry.end() ? &books[it->second] : nullptr;
+}
+
+
+BookLevel OrderBook::level_at(const PriceLadder<PriceLevel>& ladder, Price price){
+    if(price == NO_PRICE){
+        return BookLevel();
+    }
+    const PriceLevel* level = ladder.find(price);
+    return BookLevel{price, level->volume, level->count};
+}
+
+
+#ifdef CLOB_LATENCY
+// Latency table, one row per kind of order, converted from read_tsc ticks to ns
+static void print_latency(const LatencyHistogram* histograms){
+    static const char* names[] = {"limit resting", "limit crossing", "market", "cancel hit", "cancel miss"};
+    double per_ns = tsc_ticks_per_ns();
+    cout << "Latency per order in ns (" << fixed << setprecision(2) << per_ns << " timestamp ticks per ns)" << endl;
+    cout << "operation      | count      | p50    | p99    | p99.9  | max" << endl;
+    cout << "---------------+------------+--------+--------+--------+---------" << endl;
+    cout << setprecision(0);
+    for(size_t op = 0; op < (size_t)OrderOp::Count; ++op){
+        const LatencyHistogram& h = histograms[op];
+        cout << left << setw(14) << names[op] << right << " | " << setw(10) << h.count()
+             << " | " << setw(6) << h.percentile(0.50) / per_ns << " | " << setw(6) << h.percentile(0.99) / per_ns
+             << " | " << setw(6) << h.percentile(0.999) / per_ns << " | " << h.max() / per_ns << endl;
+    }
+}
+#endif
+
+
+void OrderBook::query_latency() const {
+#ifdef CLOB_LATENCY
+    print_latency(latency);
+#else
+    cout << "Latency histograms are not compiled in, build with -DCLOB_LATENCY" << endl;
+#endif
+}
+
+
+void OrderBook::reset_latency(){
+#ifdef CLOB_LATENCY
+    for(auto& histogram: latency){
+        histogram.clear();
+    }
+#endif
+}
+
+
+BookStats OrderBook::stats() const {
+    BookStats snapshot;
+    snapshot.counters = counters;
+    snapshot.resting_orders = order_index.size();
+    snapshot.tickers.reserve(books.size());
+    for(size_t i = 0; i < books.size(); ++i){
+        snapshot.tickers.push_back(TickerStats{ticker_list[i], (uint32_t)(books[i].sides[0].size() + books[i].sides[1].size()), peak_levels[i]});
+    }
+    return snapshot;
+}
+
+
+// Start counting again, peaks start from the current book
+void OrderBook::reset_stats(){
+    counters = EngineCounters();
+    counters.peak_resting_orders = order_index.size();
+    for(size_t i = 0; i < books.size(); ++i){
+        peak_levels[i] = (uint32_t)(books[i].sides[0].size() + books[i].sides[1].size());
+    }
+}
+
+
+static void print_stats(const BookStats& stats){
+    const EngineCounters& c = stats.counters;
+    cout << endl << "Orders: " << c.limit_orders << " limit, " << c.market_orders << " market, " << c.cancels << " cancels ("
+         << c.missed_cancels << " missed), " << c.skipped_orders << " skipped" << endl;
+    cout << "Fills: " << c.fills << " by " << c.aggressive_orders << " aggressive orders, " << c.levels_swept << " levels swept ("
+         << fixed << setprecision(2) << (c.aggressive_orders ? (double)c.levels_swept / c.aggressive_orders : 0.0) << " per order, max " << c.max_levels_swept << ")" << endl;
+    cout << "Levels: " << c.levels_created << " created, " << c.levels_erased << " erased" << endl;
+    cout << "Resting orders: " << stats.resting_orders << " now, peak " << c.peak_resting_orders << endl;
+    cout << "Ticker | Levels | Peak levels" << endl;
+    for(const TickerStats& ticker: stats.tickers){
+        cout << setw(6) << ticker.ticker << " | " << setw(6) << ticker.levels << " | " << ticker.peak_levels << endl;
+    }
+    cout << endl;
+}
+
+
+void OrderBook::query_stats() const {
+    print_stats(stats());
+}
+
+
+// Query PnL
+void OrderBook::query_pnl(ostream& out){
+    out << endl << fixed << setprecision(2) <<  "Total PnL: $" << to_price(pnl) << endl << endl;
+}
+
+
+// Reset order_book class
+void OrderBook::reset(){
+    clear_book();
+    checkpoints.clear(); // forget the replayed stream
+    checkpoint_orders = 0;
+    checkpoint_interval = first_checkpoint_interval;
+    replay_source = nullptr;
+    replay_source_size = 0;
+    replay_position = 0;
+    resume_from_snapshot = false;
+}
+
+
+// Empty every ticker's book and PnL
+void OrderBook::clear_book(){
+    for(auto& book: books){ // Clear entire order_book, tickers keep their dense index and their ladders keep their storage
+        book.clear();
+    }
+    pool.clear(); // release every resting order node, the pool keeps its capacity
+    order_index.clear(); // pages and sparse id nodes are kept for reuse, nothing is freed
+    pnl = 0; // reset PnL
+    trade_seq = 0;
+    last_id = -1;
+}
+
+
+// Replay orders up to max_id into the resident book
+// Moving forward only processes the orders since the last query. Moving backwards restores the latest checkpoint
+// at or below max_id and replays from there, so the cost depends on the distance rather than the file size.
+// orders must be sorted by id and stay unchanged between calls, a different vector or mode starts from an empty book,
+// or from a book restored by load_snapshot, which stands for every order up to its last id and becomes the first checkpoint.
+// Going back before a snapshot replays from the start of orders, so orders should then begin at the first id.
+void OrderBook::replay_to(const Order* first, const Order* last, int max_id, bool with_add_and_cancel){
+    if(first != replay_source || (size_t)(last - first) != replay_source_size || with_add_and_cancel != replay_with_add_and_cancel){
+        bool resume = resume_from_snapshot;
+        if(!resume){
+            reset();
+        }
+        resume_from_snapshot = false;
+        replay_source = first;
+        replay_source_size = last - first;
+        replay_with_add_and_cancel = with_add_and_cancel;
+        if(resume){
+            replay_position = upper_bound(first, last, last_id, [](int id, const Order& order){ return id < order.id; }) - first;
+            save_checkpoint();
+        }
+    }
+
+    size_t target = upper_bound(first, last, max_id,
+                                [](int id, const Order& order){ return id < order.id; }) - first; // orders with id <= max_id
+
+    if(target < replay_position){ // rewind to the latest checkpoint at or below target
+        auto it = upper_bound(checkpoints.begin(), checkpoints.end(), target,
+                              [](size_t position, const Checkpoint& checkpoint){ return position < checkpoint.position; });
+        if(it != checkpoints.begin()){
+            restore_checkpoint(*prev(it));
+        }
+        else{
+            clear_book();
+            replay_position = 0;
+        }
+    }
+
+    while(replay_position < target){ // replay forward, stopping at each checkpoint boundary on the way
+        size_t next_stop = min(target, (replay_position / checkpoint_interval + 1) * checkpoint_interval);
+        if(with_add_and_cancel){
+            process_orders_with_add_and_cancel(first + replay_position, first + next_stop);
+        }
+        else{
+            process_orders(first + replay_position, first + next_stop);
+        }
+        replay_position = next_stop;
+
+        if(replay_position % checkpoint_interval == 0 && (checkpoints.empty() || checkpoints.back().position < replay_position)){
+            save_checkpoint();
+        }
+    }
+}
+
+
+// Register the tickers of a binary order log and make its records usable by replay_to
+// Records are used in place from the mapping when the log's tick size and ticker indices agree with this book,
+// otherwise they are copied once and rewritten to this book's ticks and ticker indices
+void OrderBook::load_orders_from_log(OrderLogReader& log){
+    bool in_place = log.tick_size() == tick_size;
+    for(size_t i = 0; i < log.tickers().size(); ++i){
+        in_place &= register_ticker(log.tickers()[i]) == i;
+    }
+
+    if(!in_place){
+        Order* records = log.detach();
+        for(size_t i = 0; i < log.size(); ++i){
+            Order& order = records[i];
+            order.price = to_ticks(order.price * log.tick_size());
+            if(order.type != OrderType::None){
+                order.ticker_index = register_ticker(order.ticker);
+            }
+        }
+    }
+
+    for(const Order& order: log){ // a corrupt record must not index outside the books or be taken for a limit add
+        if(order.action > Action::None || order.type > OrderType::None ||
+           (order.type != OrderType::None && (order.ticker_index >= books.size() || order.side >= Side::None)) ||
+           (order.type == OrderType::Limit && order.price == NO_PRICE)){
+            throw runtime_error("Order " + to_string(order.id) + " in binary order log has an invalid action, type, ticker index, side or price");
+        }
+    }
+}
+
+
+// Write a csv order file as a binary order log, the csv layout (with or without Action column) is detected from its header
+void convert_csv_to_order_log(const string& csv_path, const string& log_path, double tick_size){
+    OrderBook scratch(tick_size); // assigns ticker indices while parsing
+    vector<Order> orders = csv_has_add_and_cancel(csv_path)
+        ? scratch.load_orders_from_csv_with_add_and_cancel(csv_path, numeric_limits<int>::max())
+        : scratch.load_orders_from_csv(csv_path, numeric_limits<int>::max());
+
+    OrderLogWriter writer(log_path, tick_size);
+    writer.append(orders.data(), orders.data() + orders.size());
+    writer.finish(scratch.tickers());
+}
+
+
+// Write every resting order, the tickers, PnL and the last order id to a binary book snapshot (book_snapshot.h)
+// The file is written next to path and renamed over it once complete, so a crash while saving keeps the previous snapshot
+void OrderBook::save_snapshot(const string& path) const {
+    string temp_path = path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if(file == nullptr){
+        throw runtime_error("Can not create file \"" + temp_path + "\"");
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    unsigned char header_bytes[sizeof(BookSnapshotHeader)] = {};
+    fwrite(header_bytes, 1, sizeof(header_bytes), file); // written again once the order count is known
+
+    uint64_t order_count = 0;
+    unsigned char record[sizeof(Order)];
+    for(const TickerBook& book: books){ // ticker index > buy/sell > prices low to high > FIFO
+        for(const auto& ladder: book.sides){
+            for(Price price = ladder.lowest(); price != NO_PRICE; price = ladder.next_higher(price)){
+                for(uint32_t handle = ladder.find(price)->head; handle != NIL_NODE; handle = pool[handle].next){
+                    encode_order(record, pool[handle].order);
+                    fwrite(record, sizeof(record), 1, file);
+                    ++order_count;
+                }
+            }
+        }
+    }
+    for(int32_t ticker: ticker_list){
+        unsigned char bytes[sizeof(int32_t)];
+        store_le(bytes, ticker);
+        fwrite(bytes, 1, sizeof(bytes), file);
+    }
+
+    BookSnapshotHeader header{};
+    header.version = BOOK_SNAPSHOT_VERSION;
+    header.ticker_count = (uint32_t)ticker_list.size();
+    header.order_count = order_count;
+    header.tickers_offset = sizeof(BookSnapshotHeader) + order_count * sizeof(Order);
+    header.tick_size = tick_size;
+    header.pnl = pnl;
+    header.trade_seq = trade_seq;
+    header.last_id = last_id;
+    encode_snapshot_header(header_bytes, header);
+    fseek(file, 0, SEEK_SET);
+    fwrite(header_bytes, 1, sizeof(header_bytes), file);
+
+    bool failed = ferror(file) != 0;
+    failed |= fclose(file) != 0;
+    if(!failed && rename(temp_path.c_str(), path.c_str()) != 0){
+        remove(path.c_str()); // rename does not replace an existing file on Windows
+        failed = rename(temp_path.c_str(), path.c_str()) != 0;
+    }
+    if(failed){
+        remove(temp_path.c_str());
+        throw runtime_error("Can not write file \"" + path + "\"");
+    }
+}
+
+
+// Replace the book with a binary book snapshot in one pass over the mapped file
+// Records of one price level are consecutive, so each level is looked up once and its orders are appended in FIFO order.
+// Tickers are matched by value, new ones are registered. Engine stats are kept, their peaks take in the restored book.
+void OrderBook::load_snapshot(const string& path){
+    MappedFile file(path);
+    const unsigned char* data = file.data();
+    if(file.size() < sizeof(BookSnapshotHeader) || memcmp(data, BOOK_SNAPSHOT_MAGIC, sizeof(BOOK_SNAPSHOT_MAGIC)) != 0){
+        throw runtime_error("\"" + path + "\" is not a book snapshot");
+    }
+    BookSnapshotHeader header = decode_snapshot_header(data);
+    if(header.version != BOOK_SNAPSHOT_VERSION){
+        throw runtime_error("\"" + path + "\" has unsupported book snapshot version " + to_string(header.version));
+    }
+    if(header.order_count > (file.size() - sizeof(BookSnapshotHeader)) / sizeof(Order) ||
+       header.tickers_offset < sizeof(BookSnapshotHeader) + header.order_count * sizeof(Order) ||
+       header.tickers_offset > file.size() || header.ticker_count > (file.size() - header.tickers_offset) / sizeof(int32_t)){
+        throw runtime_error("\"" + path + "\" is truncated");
+    }
+    if(header.tick_size != tick_size){
+        throw runtime_error("\"" + path + "\" was saved with tick size " + to_string(header.tick_size) + ", this book uses " + to_string(tick_size));
+    }
+
+    reset();
+    vector<uint32_t> ticker_index(header.ticker_count); // snapshot ticker index to this book's
+    for(uint32_t i = 0; i < header.ticker_count; ++i){
+        ticker_index[i] = register_ticker(load_le<int32_t>(data + header.tickers_offset + i * sizeof(int32_t)));
+    }
+
+    pool.reserve(header.order_count);
+    try{
+        const unsigned char* record = data + sizeof(BookSnapshotHeader);
+        PriceLevel* level = nullptr; // level of the previous record
+        Order previous{};
+        for(uint64_t i = 0; i < header.order_count; ++i, record += sizeof(Order)){
+            Order order = decode_order(record);
+            if(order.type != OrderType::Limit || order.side >= Side::None || order.ticker_index >= header.ticker_count || order.price == NO_PRICE || order.volume <= 0 ||
+               ticker_list[ticker_index[order.ticker_index]] != order.ticker || order_index.find(order.id) != OrderIndex::none){
+                throw runtime_error("Order " + to_string(order.id) + " in book snapshot \"" + path + "\" is not a valid resting order");
+            }
+            order.ticker_index = ticker_index[order.ticker_index];
+            if(level == nullptr || order.ticker_index != previous.ticker_index || order.side != previous.side || order.price != previous.price){
+                level = &side_ladder(order.ticker_index, order.side)[order.price];
+            }
+            order_index.insert(order.id, pool.push_back(*level, order));
+            previous = order;
+        }
+    }
+    catch(...){
+        reset(); // no half loaded book
+        throw;
+    }
+
+    pnl = header.pnl;
+    trade_seq = header.trade_seq;
+    last_id = header.last_id;
+    resume_from_snapshot = true;
+    counters.peak_resting_orders = max<uint64_t>(counters.peak_resting_orders, order_index.size());
+    for(size_t i = 0; i < books.size(); ++i){
+        peak_levels[i] = max(peak_levels[i], (uint32_t)(books[i].sides[0].size() + books[i].sides[1].size()));
+    }
+}
+
+
+// Pass every resting order to on_order, level by level in FIFO order, so restore_resting can append them as they come
+template <class OnOrder>
+void OrderBook::for_each_resting(OnOrder&& on_order) const {
+    for(const TickerBook& book: books){
+        for(const auto& ladder: book.sides){
+            for(Price price = ladder.lowest(); price != NO_PRICE; price = ladder.next_higher(price)){
+                for(uint32_t handle = ladder.find(price)->head; handle != NIL_NODE; handle = pool[handle].next){
+                    on_order(pool[handle].order);
+                }
+            }
+        }
+    }
+}
+
+
+// Rest orders straight into their levels without matching, each level is looked up once for its run of orders
+void OrderBook::restore_resting(const Order* first, const Order* last){
+    PriceLevel* level = nullptr;
+    for(const Order* it = first; it != last; ++it){
+        if(it == first || it->ticker_index != it[-1].ticker_index || it->side != it[-1].side || it->price != it[-1].price){
+            level = &side_ladder(it->ticker_index, it->side)[it->price];
+        }
+        order_index.insert(it->id, pool.push_back(*level, *it));
+    }
+}
+
+
+// Keep the resting orders for replay_to, only what is resting is stored, so an idle ticker's price band costs nothing
+// Past max_checkpoints, or max_checkpoint_orders in all, every other checkpoint is dropped and the interval doubles,
+// so memory stays bounded on any file length while the replay distance of a rewind grows with the log of it.
+void OrderBook::save_checkpoint(){
+    Checkpoint checkpoint{replay_position, {}, pnl, trade_seq, last_id};
+    checkpoint.resting.reserve(order_index.size());
+    for_each_resting([&](const Order& order){ checkpoint.resting.push_back(order); });
+    checkpoint_orders += checkpoint.resting.size();
+    checkpoints.push_back(move(checkpoint));
+
+    while(checkpoints.size() > 2 && (checkpoints.size() > max_checkpoints || checkpoint_orders > max_checkpoint_orders)){
+        size_t kept = 0;
+        for(size_t i = 0; i < checkpoints.size(); ++i){
+            if(i % 2 == 0 || i + 1 == checkpoints.size()){ // the first, which may be a loaded snapshot, and the latest always stay
+                if(kept != i){
+                    checkpoints[kept] = move(checkpoints[i]);
+                }
+                ++kept;
+            }
+            else{
+                checkpoint_orders -= checkpoints[i].resting.size();
+            }
+        }
+        checkpoints.resize(kept);
+        checkpoint_interval *= 2;
+    }
+}
+
+
+// Bring the book back to a checkpoint, tickers registered since then start empty
+void OrderBook::restore_checkpoint(const Checkpoint& checkpoint){
+    clear_book();
+    restore_resting(checkpoint.resting.data(), checkpoint.resting.data() + checkpoint.resting.size());
+    pnl = checkpoint.pnl;
+    trade_seq = checkpoint.trade_seq; // a rewound replay repeats the sequence numbers of the orders it replays again
+    last_id = checkpoint.last_id;
+    replay_position = checkpoint.position;
+}
+
+
+const size_t ShardedOrderBook::shard_ring_capacity; // bound by reference when the rings are made
+
+
+ShardedOrderBook::ShardedOrderBook(size_t shard_count, const vector<int32_t>& tickers, double tick_size, double band_min, double band_max){
+    shard_count = max<size_t>(shard_count, 1);
+    for(size_t s = 0; s < shard_count; ++s){
+        shards.push_back(make_unique<OrderBook>(tick_size, band_min, band_max));
+    }
+    missed_cancels.resize(shard_count); // sized once, the shards keep pointers into it
+    for(size_t s = 0; s < shard_count; ++s){
+        shards[s]->collect_missed_cancels(&missed_cancels[s]);
+    }
+
+    for(size_t i = 0; i < tickers.size(); ++i){ // deal tickers round robin in order of first appearance
+        uint32_t s = (uint32_t)(i % shard_count);
+        routes.push_back({s, shards[s]->register_ticker(tickers[i])});
+        ticker_shard.emplace(tickers[i], s);
+    }
+
+    for(size_t s = 0; s < shard_count; ++s){
+        rings.push_back(make_unique<SpscRing<Order>>(shard_ring_capacity));
+    }
+    for(size_t s = 0; s < shard_count; ++s){
+        workers.emplace_back([this, s]{ run_worker(s); });
+    }
+}
+
+
+ShardedOrderBook::~ShardedOrderBook(){
+    {
+        lock_guard<mutex> lock(batch_mutex);
+        stopping = true;
+    }
+    batch_ready.notify_all();
+    for(auto& worker: workers){
+        worker.join();
+    }
+}
+
+
+// Sleeps until the router starts a batch, then matches its ring until the router closes it and every order is applied
+void ShardedOrderBook::run_worker(size_t s){
+    pin_to_cpu(s + 1); // cpu 0 is left to the router
+    OrderBook& shard = *shards[s];
+    SpscRing<Order>& ring = *rings[s];
+    uint64_t seen = 0;
+    for(;;){
+        bool with_add_and_cancel;
+        {
+            unique_lock<mutex> lock(batch_mutex);
+            batch_ready.wait(lock, [&]{ return stopping || batch_seq != seen; });
+            if(stopping){
+                return;
+            }
+            seen = batch_seq;
+            with_add_and_cancel = batch_with_add_and_cancel;
+        }
+
+        for(;;){
+            Order* batch;
+            size_t n = ring.peek(batch);
+            if(n == 0){
+                if(ring.drained()){
+                    break;
+                }
+                this_thread::yield(); // ring empty, let the router catch up
+                continue;
+            }
+            if(with_add_and_cancel){
+                shard.process_orders_with_add_and_cancel(batch, batch + n);
+            }
+            else{
+                shard.process_orders(batch, batch + n);
+            }
+            ring.release(n);
+        }
+
+        lock_guard<mutex> lock(batch_mutex); // also publishes the shard's book to the router
+        if(--busy_workers == 0){
+            batch_done.notify_one();
+        }
+    }
+}
+
+
+// Route orders to the shard threads and wait until all of them are matched
+// The workers live as long as the book and are pinned to their own cpu where the platform allows, the router runs on
+// this thread. Every ticker index is checked before the first order is routed, so a bad batch leaves the shards as
+// they were.
+void ShardedOrderBook::process_orders(const Order* first, const Order* last, bool with_add_and_cancel){
+    for(const Order* it = first; it != last; ++it){
+        bool add = with_add_and_cancel ? it->action == Action::Add : true;
+        if(add && it->type != OrderType::None && it->ticker_index >= routes.size()){
+            throw out_of_range("ShardedOrderBook: order " + to_string(it->id) + " has a ticker_index that is not one of the tickers the shards were built with");
+        }
+    }
+
+    for(auto& ring: rings){
+        ring->reopen(); // every worker is waiting for the batch, none of them polls its ring
+    }
+    {
+        lock_guard<mutex> lock(batch_mutex);
+        ++batch_seq;
+        busy_workers = workers.size();
+        batch_with_add_and_cancel = with_add_and_cancel;
+    }
+    batch_ready.notify_all();
+
+    for(const Order* it = first; it != last; ++it){
+        const Order& order = *it;
+        uint32_t shard;
+        uint32_t ticker_index = order.ticker_index;
+
+        if(with_add_and_cancel && order.action == Action::Cancel){
+            shard = order_shard.find(order.cancel_target_id);
+            if(shard == OrderIndex::none){
+                shard = 0; // never routed or already cancelled, any shard reports it as not found
+            }
+            else{
+                order_shard.erase(order.cancel_target_id); // a second cancel can not find it either
+            }
+        }
+        else if((with_add_and_cancel && order.action != Action::Add) || order.type == OrderType::None){
+            continue; // ignored by the engine as well
+        }
+        else{
+            shard = routes[order.ticker_index].shard;
+            ticker_index = routes[order.ticker_index].ticker_index;
+            if(with_add_and_cancel && order.type == OrderType::Limit){
+                order_shard.insert(order.id, shard); // only limit orders can rest and be cancelled
+            }
+        }
+
+        SpscRing<Order>& ring = *rings[shard];
+        Order* slot;
+        while((slot = ring.claim()) == nullptr){
+            this_thread::yield(); // shard is behind, let it catch up
+        }
+        *slot = order;
+        slot->ticker_index = ticker_index;
+        ring.commit();
+    }
+
+    for(auto& ring: rings){
+        ring->close();
+    }
+    unique_lock<mutex> lock(batch_mutex);
+    batch_done.wait(lock, [&]{ return busy_workers == 0; });
+}
+
+
+// Each shard sees its cancels in stream order and order ids ascend through the stream, so sorting by id restores it
+vector<Order> ShardedOrderBook::take_missed_cancels(){
+    vector<Order> merged;
+    for(auto& missed: missed_cancels){
+        merged.insert(merged.end(), missed.begin(), missed.end());
+        missed.clear();
+    }
+    stable_sort(merged.begin(), merged.end(), [](const Order& a, const Order& b){ return a.id < b.id; });
+    return merged;
+}
+
+
+void ShardedOrderBook::report_missed_cancels(){
+    for(const Order& cancel: take_missed_cancels()){
+        OrderBook::print_missed_cancel(cancel);
+    }
+}
+
+
+void ShardedOrderBook::query_ticker(int ticker, ostream& out) const {
+    shard_for(ticker).query_ticker(ticker, out); // unknown tickers print an empty ladder from any shard
+}
+
+
+const OrderBook& ShardedOrderBook::shard_for(int ticker) const {
+    auto it = ticker_shard.find(ticker);
+    return *shards[it != ticker_shard.end() ? it->second : 0];
+}
+
+
+void ShardedOrderBook::query_latency() const {
+#ifdef CLOB_LATENCY
+    LatencyHistogram merged[(size_t)OrderOp::Count];
+    for(const auto& shard: shards){
+        for(size_t op = 0; op < (size_t)OrderOp::Count; ++op){
+            merged[op].merge(shard->latency_of((OrderOp)op));
+        }
+    }
+    print_latency(merged);
+#else
+    shards[0]->query_latency();
+#endif
+}
+
+
+BookStats ShardedOrderBook::stats() const {
+    BookStats total;
+    EngineCounters& c = total.counters;
+    vector<BookStats> parts;
+    for(const auto& shard: shards){
+        parts.push_back(shard->stats());
+        const EngineCounters& part = parts.back().counters;
+        c.limit_orders += part.limit_orders;
+        c.market_orders += part.market_orders;
+        c.skipped_orders += part.skipped_orders;
+        c.cancels += part.cancels;
+        c.missed_cancels += part.missed_cancels;
+        c.fills += part.fills;
+        c.aggressive_orders += part.aggressive_orders;
+        c.levels_swept += part.levels_swept;
+        c.max_levels_swept = max(c.max_levels_swept, part.max_levels_swept);
+        c.levels_created += part.levels_created;
+        c.levels_erased += part.levels_erased;
+        c.peak_resting_orders += part.peak_resting_orders; // the shards may peak at different times
+        total.resting_orders += parts.back().resting_orders;
+    }
+    for(const Route& route: routes){ // same ticker order as the book that loaded the orders
+        total.tickers.push_back(parts[route.shard].tickers[route.ticker_index]);
+    }
+    return total;
+}
+
+
+void ShardedOrderBook::query_stats() const {
+    print_stats(stats());
+}
+
+
+void ShardedOrderBook::reset_stats(){
+    for(auto& shard: shards){
+        shard->reset_stats();
+    }
+}
+
+
+void ShardedOrderBook::query_pnl(ostream& out){
+    out << endl << fixed << setprecision(2) <<  "Total PnL: $" << shards[0]->to_price(get_pnl()) << endl << endl;
+}
+
+
+int64_t ShardedOrderBook::get_pnl() const {
+    int64_t total = 0; // integer ticks, so the sum does not depend on how tickers were split
+    for(const auto& shard: shards){
+        total += shard->get_pnl();
+    }
+    return total;
+}
+
+
+void ShardedOrderBook::reset(){
+    for(auto& shard: shards){
+        shard->reset();
+    }
+    for(auto& missed: missed_cancels){
+        missed.clear();
+    }
+    order_shard.clear();
+}
+
+
+void ShardedOrderBook::pin_to_cpu(size_t slot){
+#ifdef __linux__
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0){
+        return;
+    }
+    size_t skip = slot % CPU_COUNT(&allowed); // wrap around when there are more shards than cpus
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+        if(CPU_ISSET(cpu, &allowed) && skip-- == 0){
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+            return;
+        }
+    }
+#else
+    (void)slot; // no portable affinity api, the scheduler places the workers
+#endif
+}
+
+
+// // using fstream and sstream
+// vector<Order> OrderBook::load_orders_from_csv(const string& filepath, int max_id){
+//     string line;
+//     ifstream file(filepath);
+//     vector<Order> orders;
+//     string cell; //each column value in each line, eg "ID", Ticker", "Side", "Type", "Price", "Volume"
+    
+//     if (!file.is_open()) {
+//         cerr << "Error opening file!" << endl;
+//     }
+
+//     getline(file, line); // Skip header row
+    
+//     while(getline(file, line)) {
+//         stringstream ss(line); // converts each line string / row into a stringstream object, can skip this and do it in a normal vector loop
+//         string cell; //each column value in each line, eg "ID", Ticker", "Side", "Type", "Price", "Volume"
+//         vector<string> row_data;
+
+//         while(getline(ss, cell, ',')) { // Now 'row_data' contains all the cell values for the current row
+//             row_data.push_back(cell);
+//         }
+
+//         Order order; // intialize an order struct
+//         order.id = stoi(row_data[0]); //convert string to int
+//         order.ticker = stoi(row_data[1]);
+//         order.ticker_index = register_ticker(order.ticker);
+//         order.type = parse_type(row_data[2].c_str());
+//         order.side = parse_side(row_data[3].c_str());
+//         order.price = to_ticks(stod(row_data[4])); //convert string to double, then to integer ticks
+//         order.volume = stoi(row_data[5]);
+
+//         if(order.id > max_id){
+//             return orders; //filter orders up to max_id
+//         }
+
+//         orders.push_back(order);
+
+//         // for (const auto& value : row_data) { // You can process or store 'row_data' as needed, e.g., print them
+//         //     cout << value << "\t";
+//         // }
+//         // cout << endl;
+//     }
+//     return orders;
+
+// };
@@ -0,0 +1,375 @@
+#ifndef ORDER_BOOK_H
+#define ORDER_BOOK_H
+
+// Matching engine
+//
+// OrderBook keeps one TickerBook per ticker (a PriceLadder of FIFO price levels for each side) over a shared pool of
+// resting order nodes, and matches incoming orders against it. ShardedOrderBook splits the tickers across threads.
+// clob.cpp is the interactive front end, bench.cpp the benchmark suite.
+
+#include <algorithm>
+#include <cmath> // llround for price to tick conversion
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "csv.h" // fast cpp csv parser
+#include "price_ladder.h" // flat array price levels with bitmap, tree fallback outside the band
+#include "order.h" // compact Order record
+#include "order_log.h" // binary order log, mmap loader and writer
+#include "book_snapshot.h" // binary book snapshot for warm starts
+#include "spsc_ring.h" // lock-free ring between the streaming parser and matcher
+#include "trade_log.h" // trade events and their writer thread
+#include "order_index.h" // order id to node handle
+#include "latency_histogram.h" // per order timings, compiled in with -DCLOB_LATENCY
+
+typedef io::fixed_point<6> CsvPrice; // csv prices are read as integer millionths, then rounded to ticks
+
+namespace io { // read Action / Type / Side columns straight into the enums, unknown tokens such as -1 become None
+template <> struct enum_tokens<Action> { static bool parse(const char* begin, const char* end, Action& x){ x = parse_action(begin, end); return true; } };
+template <> struct enum_tokens<OrderType> { static bool parse(const char* begin, const char* end, OrderType& x){ x = parse_type(begin, end); return true; } };
+template <> struct enum_tokens<Side> { static bool parse(const char* begin, const char* end, Side& x){ x = parse_side(begin, end); return true; } };
+}
+
+const uint32_t NIL_NODE = UINT32_MAX; // null handle for OrderPool links
+
+struct OrderNode { // resting order, intrusively linked into the FIFO of its price level
+    Order order;
+    uint32_t prev;
+    uint32_t next;
+};
+
+struct PriceLevel { // FIFO of resting orders at one price, as handles into the OrderPool
+    uint32_t head = NIL_NODE;
+    uint32_t tail = NIL_NODE;
+    int64_t volume = 0; // total remaining volume of the orders in the FIFO
+    uint32_t count = 0; // number of orders in the FIFO
+    bool empty() const { return head == NIL_NODE; }
+};
+
+// Pool of resting order nodes addressed by 32 bit handles, freed nodes are recycled through a free list
+// Handles stay valid until released, so order_index can point straight at a node for O(1) cancels
+// Linking and unlinking keep the level's volume and count totals, partial fills adjust volume themselves
+class OrderPool {
+public:
+    OrderNode& operator[](uint32_t handle){ return nodes[handle]; }
+    const OrderNode& operator[](uint32_t handle) const { return nodes[handle]; }
+
+    uint32_t push_back(PriceLevel& level, const Order& order){ // append a new node at the tail of level
+        uint32_t handle;
+        if(free_head != NIL_NODE){ // reuse a released node
+            handle = free_head;
+            free_head = nodes[handle].next;
+        }
+        else{
+            handle = (uint32_t)nodes.size();
+            nodes.emplace_back();
+        }
+
+        OrderNode& node = nodes[handle];
+        node.order = order;
+        node.prev = level.tail;
+        node.next = NIL_NODE;
+        if(level.tail != NIL_NODE){
+            nodes[level.tail].next = handle;
+        }
+        else{
+            level.head = handle;
+        }
+        level.tail = handle;
+        level.volume += order.volume;
+        ++level.count;
+        return handle;
+    }
+
+    void erase(PriceLevel& level, uint32_t handle){ // unlink node from level and release it, neighbours do not move
+        OrderNode& node = nodes[handle];
+        if(node.prev != NIL_NODE) nodes[node.prev].next = node.next;
+        else level.head = node.next;
+        if(node.next != NIL_NODE) nodes[node.next].prev = node.prev;
+        else level.tail = node.prev;
+        level.volume -= node.order.volume;
+        --level.count;
+
+        node.next = free_head;
+        free_head = handle;
+    }
+
+    void clear(){
+        nodes.clear();
+        free_head = NIL_NODE;
+    }
+
+    void reserve(size_t count){ nodes.reserve(count); } // room for count nodes before a bulk load
+
+private:
+    std::vector<OrderNode> nodes;
+    uint32_t free_head = NIL_NODE; // released nodes, chained through next
+};
+
+struct BookLevel { // one aggregated price level, as returned by the book queries
+    Price price = NO_PRICE; // in ticks, NO_PRICE when there is no such level
+    int64_t volume = 0;
+    uint32_t count = 0; // resting orders at price
+};
+
+struct BookDepth { // levels written per side by OrderBook::depth
+    size_t bids = 0;
+    size_t asks = 0;
+};
+
+// Hot path counters of one OrderBook, returned by OrderBook::stats
+// The struct starts and ends on cache line boundaries, so the counters of shards matched on different threads never share a line
+struct alignas(64) EngineCounters {
+    uint64_t limit_orders = 0;       // adds processed, by type
+    uint64_t market_orders = 0;
+    uint64_t skipped_orders = 0;     // adds without a valid type or side
+    uint64_t cancels = 0;
+    uint64_t missed_cancels = 0;     // target not in order_index, already filled, cancelled or never added
+    uint64_t fills = 0;              // trades, one per resting order an incoming order traded against
+    uint64_t aggressive_orders = 0;  // adds that traded
+    uint64_t levels_swept = 0;       // price levels traded against, summed over the aggressive orders
+    uint64_t max_levels_swept = 0;   // most levels a single order traded against
+    uint64_t levels_created = 0;
+    uint64_t levels_erased = 0;
+    uint64_t peak_resting_orders = 0;
+};
+
+struct TickerStats {
+    int32_t ticker;
+    uint32_t levels;      // price levels on both sides now
+    uint32_t peak_levels; // most at any one time
+};
+
+struct BookStats { // snapshot from OrderBook::stats
+    EngineCounters counters;
+    uint64_t resting_orders = 0;      // now
+    std::vector<TickerStats> tickers; // by dense ticker index
+};
+
+enum class OrderOp : uint8_t { LimitResting, LimitCrossing, Market, CancelHit, CancelMiss, Count }; // kinds of order timed by the latency histograms
+
+struct TickerBook { // both halves of one ticker's book, indexed by Side
+    PriceLadder<PriceLevel> sides[2];
+
+    TickerBook(Price band_low, Price band_high) : sides{{band_low, band_high}, {band_low, band_high}} {}
+
+    void clear(){ // empty both sides, keeping their storage
+        sides[0].clear();
+        sides[1].clear();
+    }
+};
+
+class OrderBook {
+public:
+    // prices between band_min and band_max are kept in flat per-tick arrays, anything outside falls back to a tree
+    // pass band_min > band_max to keep every level in the tree
+    // replay_to keeps the resting orders every checkpoint_interval orders, the interval doubles as checkpoints are thinned out
+    explicit OrderBook(double tick_size = 0.01, double band_min = 40.00, double band_max = 238.40, size_t checkpoint_interval = 10000)
+        : tick_size(tick_size), tick_units(csv_units_per_tick(tick_size)), band_low(to_ticks(band_min)), band_high(to_ticks(band_max)),
+          first_checkpoint_interval(std::max<size_t>(checkpoint_interval, 1)), checkpoint_interval(first_checkpoint_interval) {}
+
+    std::vector<Order> load_orders_from_csv(const std::string& filepath, int max_id);
+    std::vector<Order> load_orders_from_csv_with_add_and_cancel(const std::string& filepath, int max_id); // with add and cancel functionality
+    void process_orders(const std::vector<Order>& orders){ process_orders(orders.data(), orders.data() + orders.size()); }
+    void process_orders(const Order* first, const Order* last);
+    void process_orders_with_add_and_cancel(const std::vector<Order>& orders){ process_orders_with_add_and_cancel(orders.data(), orders.data() + orders.size()); } // with add and cancel functionality
+    void process_orders_with_add_and_cancel(const Order* first, const Order* last);
+    void load_orders_from_log(OrderLogReader& log); // prepare a mapped binary order log for replay, records are used in place when possible
+    void stream_orders_from_csv(const std::string& filepath, int max_id, bool with_add_and_cancel); // parse and match on two threads without keeping the orders
+    void replay_to(const std::vector<Order>& orders, int max_id, bool with_add_and_cancel){ replay_to(orders.data(), orders.data() + orders.size(), max_id, with_add_and_cancel); }
+    void replay_to(const Order* first, const Order* last, int max_id, bool with_add_and_cancel); // move the resident book to the state after max_id
+    void query_ticker(int ticker, std::ostream& out = std::cout) const; // trading ladder format, unknown tickers print an empty ladder
+    void query_ticker_snapshot(int ticker, std::ostream& out = std::cout) const; // default orderbook snapshot format
+    void query_pnl(std::ostream& out = std::cout);
+    BookLevel best_bid(int ticker) const; // highest buy level, from the ladder's cached best price
+    BookLevel best_ask(int ticker) const; // lowest sell level
+    BookDepth depth(int ticker, size_t levels, BookLevel* bids, BookLevel* asks) const; // best first, up to levels per side into the caller's buffers
+    BookStats stats() const; // counters of the work done since the start or reset_stats, including orders replayed again after a rewind
+    void query_stats() const;
+    void reset_stats();
+    void query_latency() const; // latency percentiles per kind of order since the start or reset_latency, with CLOB_LATENCY
+    void reset_latency();
+#ifdef CLOB_LATENCY
+    const LatencyHistogram& latency_of(OrderOp op) const { return latency[(size_t)op]; } // in read_tsc ticks
+#endif
+    void reset(); // empty book, O(tickers + levels + index pages + checkpoints), keeps the band, pool and index storage
+    void save_snapshot(const std::string& path) const; // resting orders, PnL and the last order id, see book_snapshot.h
+    void load_snapshot(const std::string& path); // replace the book with a snapshot, replay_to then carries on after its last order id
+    int last_order_id() const { return last_id; } // id of the last order applied, -1 for none
+    bool is_resting(int id) const { return order_index.find(id) != OrderIndex::none; } // a limit order with this id is in the book
+    uint32_t register_ticker(int ticker); // dense index of ticker, creating its book on first use
+    const std::vector<int32_t>& tickers() const { return ticker_list; } // tickers by dense index
+    void collect_missed_cancels(std::vector<Order>* out){ missed_cancels = out; } // cancels whose target is not resting go to out instead of cout, nullptr to print them again
+    void publish_trades(TradeFeed* feed){ trade_feed = feed; } // push a Trade for every fill into feed, nullptr to stop
+    static void print_missed_cancel(const Order& cancel, std::ostream& out = std::cout){ out << "Cancel_Target_Id " << cancel.cancel_target_id << " not found, skipping to next order..." << std::endl; }
+
+    double get_tick_size() const { return tick_size; }
+    Price to_ticks(double price) const { return std::llround(price / tick_size); } // round a decimal price to the nearest tick
+    Price to_ticks(CsvPrice price) const { // same rounding in integers when the tick is a whole number of csv price units
+        if(tick_units == 0){
+            return to_ticks((double)price.value / CsvPrice::scale);
+        }
+        return price.value >= 0 ? (price.value + tick_units / 2) / tick_units : -((tick_units / 2 - price.value) / tick_units);
+    }
+    double to_price(Price ticks) const { return ticks * tick_size; } // convert ticks back to a decimal price for display
+    int64_t get_pnl() const { return pnl; } // in ticks x volume
+
+private:
+    template <class OnOrder> void for_each_csv_order(const std::string& filepath, OnOrder&& on_order) const; // decode csv rows one at a time
+    template <class OnOrder> void for_each_csv_order_with_add_and_cancel(const std::string& filepath, OnOrder&& on_order) const;
+    PriceLadder<PriceLevel>& side_ladder(uint32_t ticker_index, Side side){ return books[ticker_index].sides[(size_t)side]; } // one half of a ticker's book, a single array index
+    const TickerBook* find_book(int ticker) const; // nullptr for tickers never seen, queries do not register them
+    static BookLevel level_at(const PriceLadder<PriceLevel>& ladder, Price price);
+    void pop_front(PriceLevel& level); // remove a filled order from the front of level
+    void add_order(Order& order); // match, then rest the remainder of a limit order
+    template <Side side> void match(Order& order); // sweep the opposite side up to order's limit
+    bool cancel_order(const Order& order); // false when the target is not resting
+    int fill_level(PriceLevel& level, Order& order, Price price); // match order against one level, returns the volume filled
+    void emit_trade(const Order& aggressor, const Order& resting, Price price, int volume){ // a branch and a ring slot when publishing, nothing otherwise
+        if(trade_feed != nullptr){
+            trade_feed->push(Trade{++trade_seq, aggressor.id, resting.id, aggressor.ticker, volume, price});
+        }
+    }
+
+#ifdef CLOB_LATENCY
+    uint64_t latency_start() const { return read_tsc(); }
+    void latency_stop(OrderOp op, uint64_t start){
+        if(op != OrderOp::Count){
+            latency[(size_t)op].record(read_tsc() - start);
+        }
+    }
+#else
+    uint64_t latency_start() const { return 0; } // compiled out, along with working out the kind of order
+    void latency_stop(OrderOp, uint64_t){}
+#endif
+    static OrderOp add_kind(const Order& incoming, const Order& remaining){ // Count for adds the engine skips
+        if(incoming.type == OrderType::Market) return OrderOp::Market;
+        if(incoming.type != OrderType::Limit) return OrderOp::Count;
+        return remaining.volume < incoming.volume ? OrderOp::LimitCrossing : OrderOp::LimitResting;
+    }
+
+    static int64_t csv_units_per_tick(double tick_size){ // 0 when tick_size is not a multiple of 1 / CsvPrice::scale
+        double units = tick_size * CsvPrice::scale;
+        return units >= 1 && std::fabs(units - std::llround(units)) < 1e-6 ? std::llround(units) : 0;
+    }
+
+    double tick_size; // price increment represented by one tick, e.g. 0.01
+    int64_t tick_units; // tick_size in csv price units, e.g. 10000 for 0.01
+    Price band_low, band_high; // flat array price band in ticks
+    std::unordered_map<int, uint32_t> ticker_registry; // ticker to dense index into books
+    std::vector<int32_t> ticker_list; // dense index to ticker
+    std::vector<TickerBook> books; // order_book, sorted by: ticker index > buy/sell > prices > order nodes (FIFO)
+    OrderPool pool; // storage for every resting order
+    std::unique_ptr<NodeArena> index_arena = std::make_unique<NodeArena>(); // nodes of order_index's sparse id map, stays put when the book is moved
+    OrderIndex order_index{index_arena.get()}; // all outstanding limit orders, id to node handle
+    int64_t pnl = 0; // tracks total pnl in ticks x volume, only matched orders realise PnL, cancelled orders do not affect PnL
+    std::vector<Order>* missed_cancels = nullptr; // set by collect_missed_cancels
+    TradeFeed* trade_feed = nullptr; // set by publish_trades
+    uint64_t trade_seq = 0; // fills so far, the seq of the last trade event
+    int last_id = -1; // see last_order_id, set once per process_orders call
+    EngineCounters counters; // see stats, not part of the book state so checkpoints leave them alone
+    std::vector<uint32_t> peak_levels; // by ticker index
+#ifdef CLOB_LATENCY
+    LatencyHistogram latency[(size_t)OrderOp::Count]; // read_tsc ticks per order, by OrderOp
+#endif
+
+    struct Checkpoint { // the book after the first position orders of the replayed stream
+        size_t position;
+        std::vector<Order> resting; // in for_each_resting order, the ladders, pool and order_index are rebuilt from them
+        int64_t pnl;
+        uint64_t trade_seq;
+        int last_id;
+    };
+
+    void clear_book();
+    template <class OnOrder> void for_each_resting(OnOrder&& on_order) const; // ticker index > buy/sell > prices low to high > FIFO
+    void restore_resting(const Order* first, const Order* last); // append resting orders given in for_each_resting order
+    void save_checkpoint();
+    void restore_checkpoint(const Checkpoint& checkpoint);
+
+    static const size_t stream_ring_capacity = 1 << 14; // orders in flight between the parser and matching threads
+
+    static const size_t max_checkpoints = 64;
+    static const size_t max_checkpoint_orders = size_t(1) << 23; // resting orders kept over all checkpoints, 256 MB
+
+    size_t first_checkpoint_interval;
+    size_t checkpoint_interval; // orders between checkpoints
+    std::vector<Checkpoint> checkpoints; // ascending by position
+    size_t checkpoint_orders = 0; // resting orders kept in checkpoints
+    const Order* replay_source = nullptr; // orders the resident book was replayed from, checkpoints belong to this stream
+    size_t replay_source_size = 0;
+    bool replay_with_add_and_cancel = false;
+    size_t replay_position = 0; // number of orders of replay_source already applied to the book
+    bool resume_from_snapshot = false; // set by load_snapshot, the next replay_to starts after last_id instead of from an empty book
+};
+
+
+// Tickers never interact, so the book can be split by ticker across worker threads
+// Every shard is a whole OrderBook (its books, pool and its part of order_index) matched on its own pinned thread,
+// while the calling thread routes orders to the shards through one SpscRing each: adds go to the shard owning their
+// ticker, cancels to the shard their target was routed to. PnL is summed in integer ticks and missed cancels are
+// merged back into stream order, so the output is identical to the single-threaded engine.
+class ShardedOrderBook {
+public:
+    // orders passed to process_orders carry ticker indices into tickers, e.g. OrderBook::tickers() of the book that loaded them
+    ShardedOrderBook(size_t shard_count, const std::vector<int32_t>& tickers, double tick_size = 0.01, double band_min = 40.00, double band_max = 238.40);
+    ~ShardedOrderBook(); // stops and joins the shard workers
+
+    ShardedOrderBook(const ShardedOrderBook&) = delete; // the workers hold this
+    ShardedOrderBook& operator=(const ShardedOrderBook&) = delete;
+
+    void process_orders(const Order* first, const Order* last, bool with_add_and_cancel); // returns once every shard has applied its orders
+    std::vector<Order> take_missed_cancels(); // cancels since the last call whose target was not resting, in stream order
+    void report_missed_cancels(); // print them like the single-threaded engine does
+    void query_ticker(int ticker, std::ostream& out = std::cout) const; // trading ladder format, from the shard owning ticker
+    void query_pnl(std::ostream& out = std::cout);
+    BookStats stats() const; // summed over the shards, peak_resting_orders is the sum of the shard peaks
+    void query_stats() const;
+    void reset_stats();
+    void query_latency() const; // merged over the shards
+    BookLevel best_bid(int ticker) const { return shard_for(ticker).best_bid(ticker); } // shards are idle between process_orders calls
+    BookLevel best_ask(int ticker) const { return shard_for(ticker).best_ask(ticker); }
+    BookDepth depth(int ticker, size_t levels, BookLevel* bids, BookLevel* asks) const { return shard_for(ticker).depth(ticker, levels, bids, asks); }
+    void reset();
+    int64_t get_pnl() const; // total over all shards, in ticks x volume
+    size_t shard_count() const { return shards.size(); }
+
+private:
+    struct Route { // where the orders of one ticker index go
+        uint32_t shard;
+        uint32_t ticker_index; // dense index of the ticker inside its shard
+    };
+
+    static const size_t shard_ring_capacity = 1 << 12; // orders in flight between the router and each shard
+    static void pin_to_cpu(size_t slot); // bind the calling thread to the slot-th usable cpu
+    void run_worker(size_t s); // body of the thread matching shard s, one batch per process_orders call
+    const OrderBook& shard_for(int ticker) const; // unknown tickers go to the first shard
+
+    std::vector<std::unique_ptr<OrderBook>> shards;
+    std::vector<std::vector<Order>> missed_cancels; // per shard, in the order the shard saw them
+    std::vector<Route> routes; // by ticker index of the incoming orders
+    std::unordered_map<int, uint32_t> ticker_shard; // ticker to owning shard, for queries
+    OrderIndex order_shard; // id of every routed limit order not yet cancelled to its shard, for cancels
+
+    std::vector<std::unique_ptr<SpscRing<Order>>> rings; // router to shard s, reopened for every batch
+    std::vector<std::thread> workers; // started in the constructor, idle between batches
+    std::mutex batch_mutex;
+    std::condition_variable batch_ready; // a batch was started or the book is going away
+    std::condition_variable batch_done; // the last busy worker drained its ring
+    uint64_t batch_seq = 0; // batches started so far
+    size_t busy_workers = 0; // workers still draining the current batch
+    bool batch_with_add_and_cancel = false;
+    bool stopping = false;
+};
+
+
+void convert_csv_to_order_log(const std::string& csv_path, const std::string& log_path, double tick_size);
+bool csv_has_add_and_cancel(const std::string& csv_path);
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef ORDER_INDEX_H
+#define ORDER_INDEX_H
+
+// Order id to node handle of every resting order
+//
+// Order ids in the feeds are dense and increasing, so the index is a table indexed by id - base, cut into pages of
+// page_size slots that are allocated as ids reach them and go to a spare list once every order on them is gone, so
+// the table stops allocating once it has reached its peak number of pages. A lookup is one subtraction, one
+// directory load and one slot load, and a live order costs 4 bytes plus its share of a page. Ids below base and ids
+// far beyond the highest page (more than max_gap_pages away) go to a hash map instead, so a stray id can not blow up
+// the directory.
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "slab_allocator.h" // fallback map nodes
+
+typedef std::unordered_map<int, uint32_t, std::hash<int>, std::equal_to<int>, SlabAllocator<std::pair<const int, uint32_t>>> OrderIdMap;
+
+class OrderIndex {
+public:
+    static const uint32_t none = UINT32_MAX; // find result for ids without a resting order
+    static const int page_bits = 10;
+    static const size_t page_size = size_t(1) << page_bits; // slots per page, 4 KB
+    static const size_t max_gap_pages = 1024;                // ids up to 1M beyond the table still extend it
+
+    explicit OrderIndex(NodeArena* arena = nullptr) : fallback(0, std::hash<int>(), std::equal_to<int>(), SlabAllocator<std::pair<const int, uint32_t>>(arena)) {}
+
+    OrderIndex(const OrderIndex& other) : fallback(other.fallback) { copy_pages(other); } // live pages only, spare pages stay behind
+
+    OrderIndex& operator=(const OrderIndex& other){
+        if(this != &other){
+            clear();
+            fallback = other.fallback;
+            copy_pages(other);
+        }
+        return *this;
+    }
+
+    uint32_t find(int id) const {
+        uint64_t offset = offset_of(id);
+        if(offset < (uint64_t)directory.size() << page_bits){
+            const uint32_t* page = directory[offset >> page_bits].get();
+            uint32_t handle = page != nullptr ? page[offset & (page_size - 1)] : none;
+            if(handle != none || fallback.empty()){
+                return handle;
+            }
+        }
+        auto it = fallback.find(id);
+        return it != fallback.end() ? it->second : none;
+    }
+
+    void insert(int id, uint32_t handle){ // a repeated id replaces the earlier entry, as with a map
+        uint32_t* slot = dense_slot(id);
+        if(slot == nullptr){
+            live += fallback.insert_or_assign(id, handle).second;
+            return;
+        }
+        if(!fallback.empty() && fallback.erase(id)){ // added while its range was still sparse
+            --live;
+        }
+        if(*slot == none){
+            ++live;
+            ++page_live[offset_of(id) >> page_bits];
+        }
+        *slot = handle;
+    }
+
+    void erase(int id){
+        uint64_t offset = offset_of(id);
+        if(offset < (uint64_t)directory.size() << page_bits){
+            size_t p = offset >> page_bits;
+            uint32_t* page = directory[p].get();
+            if(page != nullptr && page[offset & (page_size - 1)] != none){
+                page[offset & (page_size - 1)] = none;
+                --live;
+                if(--page_live[p] == 0 && p + 1 != directory.size()){
+                    release_page(p); // the last page stays, the next ids land on it
+                }
+                return;
+            }
+        }
+        live -= fallback.erase(id);
+    }
+
+    size_t size() const { return live; }
+
+    void clear(){ // O(pages), every page is kept as a spare
+        for(size_t p = 0; p < directory.size(); ++p){
+            if(directory[p] != nullptr){
+                release_page(p);
+            }
+        }
+        directory.clear();
+        page_live.clear();
+        fallback.clear();
+        base = unset;
+        live = 0;
+    }
+
+private:
+    static const int64_t unset = INT64_MIN;
+
+    uint64_t offset_of(int id) const { return (uint64_t)(int64_t)id - (uint64_t)base; } // wraps to a huge offset below base or while unset
+
+    uint32_t* dense_slot(int id){ // slot of id in the table, extending it when id is close enough, nullptr for sparse ids
+        if(base == unset){
+            if(id < 0){
+                return nullptr;
+            }
+            base = (int64_t)id & ~(int64_t)(page_size - 1);
+        }
+        if((int64_t)id < base){
+            return nullptr;
+        }
+        size_t p = (size_t)(offset_of(id) >> page_bits);
+        if(p >= directory.size()){
+            if(p - directory.size() >= max_gap_pages){
+                return nullptr;
+            }
+            directory.resize(p + 1);
+            page_live.resize(p + 1, 0);
+        }
+        if(directory[p] == nullptr){
+            directory[p] = new_page();
+        }
+        return &directory[p][offset_of(id) & (page_size - 1)];
+    }
+
+    std::unique_ptr<uint32_t[]> new_page(){
+        std::unique_ptr<uint32_t[]> page;
+        if(!spare.empty()){
+            page = std::move(spare.back());
+            spare.pop_back();
+        }
+        else{
+            page.reset(new uint32_t[page_size]);
+        }
+        std::memset(page.get(), 0xff, page_size * sizeof(uint32_t)); // every slot none
+        return page;
+    }
+
+    void release_page(size_t p){
+        spare.push_back(std::move(directory[p]));
+        page_live[p] = 0;
+    }
+
+    void copy_pages(const OrderIndex& other){
+        base = other.base;
+        live = other.live;
+        page_live = other.page_live;
+        directory.resize(other.directory.size());
+        for(size_t p = 0; p < directory.size(); ++p){
+            if(other.directory[p] != nullptr){
+                directory[p] = new_page();
+                std::memcpy(directory[p].get(), other.directory[p].get(), page_size * sizeof(uint32_t));
+            }
+        }
+    }
+
+    int64_t base = unset; // id of slot 0 of page 0, a multiple of page_size
+    std::vector<std::unique_ptr<uint32_t[]>> directory; // page p holds ids base + p * page_size onwards, nullptr when it has no orders
+    std::vector<uint32_t> page_live; // orders per page
+    std::vector<std::unique_ptr<uint32_t[]>> spare; // released pages, reused before allocating
+    OrderIdMap fallback; // sparse ids
+    size_t live = 0;
+};
+
+#endif
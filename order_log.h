@@ -0,0 +1,317 @@
+#ifndef ORDER_LOG_H
+#define ORDER_LOG_H
+
+// Binary order log
+//
+// A fixed-width little-endian file that can be mapped and replayed without parsing:
+//
+//   OrderLogHeader            64 bytes
+//   Order records             row_count x 32 bytes, starting at records_offset (64)
+//   ticker table              ticker_count x int32, ticker at position i has ticker_index i
+//
+// Records use the Order layout from order.h with prices in ticks of tick_size. The ticker table is written last
+// so a writer can stream records without knowing every ticker up front.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "order.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ORDER_LOG_MMAP
+#endif
+
+const uint32_t ORDER_LOG_VERSION = 1;
+const char ORDER_LOG_MAGIC[8] = {'C', 'L', 'O', 'B', 'L', 'O', 'G', '\0'};
+
+struct OrderLogHeader {
+    char magic[8];            // ORDER_LOG_MAGIC
+    uint32_t version;         // ORDER_LOG_VERSION
+    uint32_t record_size;     // sizeof(Order)
+    uint64_t row_count;
+    uint64_t records_offset;  // byte offset of the first record
+    uint64_t tickers_offset;  // byte offset of the ticker table
+    uint32_t ticker_count;
+    uint32_t reserved;
+    double tick_size;         // price increment of one tick in the records
+    uint64_t reserved2;
+};
+static_assert(sizeof(OrderLogHeader) == 64, "OrderLogHeader is 64 bytes on disk");
+
+
+inline bool host_is_little_endian(){
+    const uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+// little-endian field encoding, a plain copy on little-endian hosts and a byte swap elsewhere
+template <class T> void store_le(unsigned char* out, T value){
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    bool little = host_is_little_endian();
+    for(size_t i = 0; i < sizeof(T); ++i){
+        out[i] = little ? bytes[i] : bytes[sizeof(T) - 1 - i];
+    }
+}
+
+template <class T> T load_le(const unsigned char* in){
+    unsigned char bytes[sizeof(T)];
+    bool little = host_is_little_endian();
+    for(size_t i = 0; i < sizeof(T); ++i){
+        bytes[i] = little ? in[i] : in[sizeof(T) - 1 - i];
+    }
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+inline void encode_order(unsigned char* out, const Order& order){
+    std::memset(out, 0, sizeof(Order));
+    store_le(out + 0, order.id);
+    store_le(out + 4, order.ticker);
+    out[8] = (unsigned char)order.action;
+    out[9] = (unsigned char)order.type;
+    out[10] = (unsigned char)order.side;
+    store_le(out + 12, order.ticker_index);
+    store_le(out + 16, order.price);
+    store_le(out + 24, order.volume);
+    store_le(out + 28, order.cancel_target_id);
+}
+
+inline Order decode_order(const unsigned char* in){
+    Order order{};
+    order.id = load_le<int32_t>(in + 0);
+    order.ticker = load_le<int32_t>(in + 4);
+    order.action = (Action)in[8];
+    order.type = (OrderType)in[9];
+    order.side = (Side)in[10];
+    order.ticker_index = load_le<uint32_t>(in + 12);
+    order.price = load_le<Price>(in + 16);
+    order.volume = load_le<int32_t>(in + 24);
+    order.cancel_target_id = load_le<int32_t>(in + 28);
+    return order;
+}
+
+
+// Read-only view of a whole file, memory mapped where the platform supports it
+class MappedFile {
+public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    explicit MappedFile(const std::string& path){
+#ifdef ORDER_LOG_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            throw std::runtime_error("Can not open file \"" + path + "\": " + std::strerror(errno));
+        }
+        struct stat st;
+        if(::fstat(fd, &st) != 0){
+            ::close(fd);
+            throw std::runtime_error("Can not stat file \"" + path + "\"");
+        }
+        length = (size_t)st.st_size;
+        if(length > 0){
+            base = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(base == MAP_FAILED){
+                ::close(fd);
+                throw std::runtime_error("Can not map file \"" + path + "\": " + std::strerror(errno));
+            }
+            ::madvise(base, length, MADV_SEQUENTIAL); // replay reads the records front to back
+        }
+        ::close(fd); // the mapping keeps the file alive
+#else
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if(file == nullptr){
+            throw std::runtime_error("Can not open file \"" + path + "\"");
+        }
+        std::fseek(file, 0, SEEK_END);
+        buffer.resize((size_t)std::ftell(file));
+        std::fseek(file, 0, SEEK_SET);
+        size_t read = std::fread(buffer.data(), 1, buffer.size(), file);
+        std::fclose(file);
+        if(read != buffer.size()){
+            throw std::runtime_error("Can not read file \"" + path + "\"");
+        }
+#endif
+    }
+
+    ~MappedFile(){
+#ifdef ORDER_LOG_MMAP
+        if(base != nullptr){
+            ::munmap(base, length);
+        }
+#endif
+    }
+
+#ifdef ORDER_LOG_MMAP
+    const unsigned char* data() const { return (const unsigned char*)base; }
+    size_t size() const { return length; }
+#else
+    const unsigned char* data() const { return buffer.data(); }
+    size_t size() const { return buffer.size(); }
+#endif
+
+private:
+#ifdef ORDER_LOG_MMAP
+    void* base = nullptr;
+    size_t length = 0;
+#else
+    std::vector<unsigned char> buffer;
+#endif
+};
+
+
+// Maps a binary order log. On little-endian hosts the records are used in place from the mapping,
+// otherwise they are decoded once into memory.
+class OrderLogReader {
+public:
+    explicit OrderLogReader(const std::string& path) : file(path) {
+        const unsigned char* data = file.data();
+        if(file.size() < sizeof(OrderLogHeader) || std::memcmp(data, ORDER_LOG_MAGIC, sizeof(ORDER_LOG_MAGIC)) != 0){
+            throw std::runtime_error("\"" + path + "\" is not a binary order log");
+        }
+
+        std::memcpy(header.magic, data, sizeof(header.magic));
+        header.version = load_le<uint32_t>(data + 8);
+        header.record_size = load_le<uint32_t>(data + 12);
+        header.row_count = load_le<uint64_t>(data + 16);
+        header.records_offset = load_le<uint64_t>(data + 24);
+        header.tickers_offset = load_le<uint64_t>(data + 32);
+        header.ticker_count = load_le<uint32_t>(data + 40);
+        header.tick_size = load_le<double>(data + 48);
+
+        if(header.version != ORDER_LOG_VERSION || header.record_size != sizeof(Order)){
+            throw std::runtime_error("\"" + path + "\" has unsupported order log version " + std::to_string(header.version));
+        }
+        if(header.records_offset % alignof(Order) != 0 || header.records_offset > file.size() || header.tickers_offset > file.size() ||
+           header.row_count > (file.size() - header.records_offset) / sizeof(Order) || // divided, a hostile count must not wrap the bound
+           header.ticker_count > (file.size() - header.tickers_offset) / sizeof(int32_t)){
+            throw std::runtime_error("\"" + path + "\" is truncated");
+        }
+
+        ticker_table.resize(header.ticker_count);
+        for(uint32_t i = 0; i < header.ticker_count; ++i){
+            ticker_table[i] = load_le<int32_t>(data + header.tickers_offset + i * sizeof(int32_t));
+        }
+
+        if(host_is_little_endian()){
+            records = reinterpret_cast<const Order*>(data + header.records_offset); // in place, no parsing or copying
+        }
+        else{
+            detach();
+        }
+    }
+
+    const OrderLogHeader& info() const { return header; }
+    double tick_size() const { return header.tick_size; }
+    const std::vector<int32_t>& tickers() const { return ticker_table; }
+
+    const Order* begin() const { return records; }
+    const Order* end() const { return records + header.row_count; }
+    size_t size() const { return header.row_count; }
+    bool in_place() const { return copy.empty() && header.row_count > 0; }
+
+    Order* detach(){ // copy the records out of the mapping so they can be rewritten
+        if(copy.empty() && header.row_count > 0){
+            copy.resize(header.row_count);
+            const unsigned char* data = file.data() + header.records_offset;
+            for(size_t i = 0; i < copy.size(); ++i){
+                copy[i] = decode_order(data + i * sizeof(Order));
+            }
+            records = copy.data();
+        }
+        return copy.data();
+    }
+
+private:
+    MappedFile file;
+    OrderLogHeader header{};
+    std::vector<int32_t> ticker_table;
+    std::vector<Order> copy; // decoded records when they can't be used in place
+    const Order* records = nullptr;
+};
+
+
+// Streams records into a binary order log, the header and ticker table are completed by finish()
+class OrderLogWriter {
+public:
+    OrderLogWriter(const OrderLogWriter&) = delete;
+    OrderLogWriter& operator=(const OrderLogWriter&) = delete;
+
+    OrderLogWriter(const std::string& path, double tick_size) : path(path), tick_size(tick_size) {
+        file = std::fopen(path.c_str(), "wb");
+        if(file == nullptr){
+            throw std::runtime_error("Can not create file \"" + path + "\"");
+        }
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        unsigned char placeholder[sizeof(OrderLogHeader)] = {};
+        std::fwrite(placeholder, 1, sizeof(placeholder), file); // header is written once the counts are known
+    }
+
+    ~OrderLogWriter(){
+        if(file != nullptr){
+            std::fclose(file);
+        }
+    }
+
+    void append(const Order& order){
+        unsigned char record[sizeof(Order)];
+        encode_order(record, order); // same bytes as the struct on little-endian hosts, with the padding zeroed
+        std::fwrite(record, sizeof(record), 1, file);
+        ++row_count;
+    }
+
+    void append(const Order* first, const Order* last){
+        for(; first != last; ++first){
+            append(*first);
+        }
+    }
+
+    void finish(const std::vector<int32_t>& tickers){ // tickers[i] is the ticker with ticker_index i
+        uint64_t tickers_offset = sizeof(OrderLogHeader) + row_count * sizeof(Order);
+        for(int32_t ticker: tickers){
+            unsigned char bytes[sizeof(int32_t)];
+            store_le(bytes, ticker);
+            std::fwrite(bytes, 1, sizeof(bytes), file);
+        }
+
+        unsigned char header[sizeof(OrderLogHeader)] = {};
+        std::memcpy(header, ORDER_LOG_MAGIC, sizeof(ORDER_LOG_MAGIC));
+        store_le(header + 8, ORDER_LOG_VERSION);
+        store_le(header + 12, (uint32_t)sizeof(Order));
+        store_le(header + 16, row_count);
+        store_le(header + 24, (uint64_t)sizeof(OrderLogHeader));
+        store_le(header + 32, tickers_offset);
+        store_le(header + 40, (uint32_t)tickers.size());
+        store_le(header + 48, tick_size);
+        std::fseek(file, 0, SEEK_SET);
+        std::fwrite(header, 1, sizeof(header), file);
+
+        bool failed = std::ferror(file) != 0;
+        failed |= std::fclose(file) != 0;
+        file = nullptr;
+        if(failed){
+            throw std::runtime_error("Can not write file \"" + path + "\"");
+        }
+    }
+
+    uint64_t rows() const { return row_count; }
+
+private:
+    std::string path;
+    double tick_size;
+    FILE* file = nullptr;
+    uint64_t row_count = 0;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef PRICE_LADDER_H
+#define PRICE_LADDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+typedef int64_t Price; // fixed-point price, counted in ticks of OrderBook::tick_size
+
+const Price NO_PRICE = std::numeric_limits<Price>::min(); // returned by ladder lookups when there is no level
+
+
+// index of the lowest / highest set bit, x must be non zero
+inline int lowest_bit(uint64_t x){
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+inline int highest_bit(uint64_t x){
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse64(&i, x);
+    return (int)i;
+#else
+    return 63 - __builtin_clzll(x);
+#endif
+}
+
+
+// Three level occupancy bitmap over up to 64^3 slots
+// leaf has one bit per slot, mid one bit per non-empty leaf word, top one bit per non-empty mid word,
+// so finding the next / previous occupied slot is at most three find-first-set operations
+class LevelBitmap {
+public:
+    static const size_t max_slots = 64 * 64 * 64;
+
+    void resize(size_t slots){ // slots must not exceed max_slots
+        slot_count = slots;
+        leaf.assign((slots + 63) / 64, 0);
+        mid.assign((leaf.size() + 63) / 64, 0);
+        top = 0;
+    }
+
+    size_t size() const { return slot_count; }
+
+    bool test(size_t i) const { return (leaf[i >> 6] >> (i & 63)) & 1; }
+
+    void set(size_t i){
+        leaf[i >> 6] |= 1ULL << (i & 63);
+        mid[i >> 12] |= 1ULL << ((i >> 6) & 63);
+        top |= 1ULL << (i >> 12);
+    }
+
+    void clear(size_t i){
+        leaf[i >> 6] &= ~(1ULL << (i & 63));
+        if(leaf[i >> 6] == 0){ // propagate emptiness upwards
+            mid[i >> 12] &= ~(1ULL << ((i >> 6) & 63));
+            if(mid[i >> 12] == 0){
+                top &= ~(1ULL << (i >> 12));
+            }
+        }
+    }
+
+    long next(size_t i) const { // lowest set slot >= i, or -1
+        if(i >= slot_count){
+            return -1;
+        }
+
+        size_t w = i >> 6;
+        uint64_t bits = leaf[w] & (~0ULL << (i & 63));
+        if(bits){
+            return (long)(w * 64 + lowest_bit(bits));
+        }
+
+        size_t m = w >> 6;
+        size_t b = (w & 63) + 1;
+        bits = b < 64 ? mid[m] & (~0ULL << b) : 0; // remaining leaf words in this mid word
+        if(!bits){
+            b = m + 1;
+            bits = b < 64 ? top & (~0ULL << b) : 0; // remaining mid words
+            if(!bits){
+                return -1;
+            }
+            m = lowest_bit(bits);
+            bits = mid[m];
+        }
+
+        w = m * 64 + lowest_bit(bits);
+        return (long)(w * 64 + lowest_bit(leaf[w]));
+    }
+
+    long prev(size_t i) const { // highest set slot <= i, or -1
+        if(slot_count == 0){
+            return -1;
+        }
+        if(i >= slot_count){
+            i = slot_count - 1;
+        }
+
+        size_t w = i >> 6;
+        uint64_t bits = leaf[w] & (~0ULL >> (63 - (i & 63)));
+        if(bits){
+            return (long)(w * 64 + highest_bit(bits));
+        }
+
+        size_t m = w >> 6;
+        size_t b = w & 63;
+        bits = b > 0 ? mid[m] & (~0ULL >> (64 - b)) : 0; // preceding leaf words in this mid word
+        if(!bits){
+            bits = m > 0 ? top & (~0ULL >> (64 - m)) : 0; // preceding mid words
+            if(!bits){
+                return -1;
+            }
+            m = highest_bit(bits);
+            bits = mid[m];
+        }
+
+        w = m * 64 + highest_bit(bits);
+        return (long)(w * 64 + highest_bit(leaf[w]));
+    }
+
+private:
+    size_t slot_count = 0;
+    std::vector<uint64_t> leaf;
+    std::vector<uint64_t> mid;
+    uint64_t top = 0;
+};
+
+
+// One side of a ticker's book, keyed by price in ticks
+// Prices inside [band_low, band_high] live in a flat array indexed by tick with an occupancy bitmap,
+// prices outside the band fall back to a red black tree. An empty band (band_low > band_high) makes this a plain tree.
+// The lowest and highest levels are cached and only searched for again when one of them is erased.
+template <class Level>
+class PriceLadder {
+public:
+    PriceLadder() : PriceLadder(1, 0) {}
+
+    PriceLadder(Price band_low, Price band_high) : band_low(band_low), band_high(band_high) {
+        if(band_high >= band_low && (size_t)(band_high - band_low) >= LevelBitmap::max_slots){
+            this->band_high = band_low + (Price)LevelBitmap::max_slots - 1; // clamp band to bitmap capacity, the rest goes to the tree
+        }
+    }
+
+    bool empty() const { return level_count == 0; }
+    size_t size() const { return level_count; }
+
+    bool count(Price price) const {
+        if(in_band(price)){
+            return !levels.empty() && occupied.test(price - band_low);
+        }
+        return overflow.count(price);
+    }
+
+    const Level* find(Price price) const { // level at price, or nullptr
+        if(in_band(price)){
+            return !levels.empty() && levels[price - band_low] ? &*levels[price - band_low] : nullptr;
+        }
+        auto it = overflow.find(price);
+        return it != overflow.end() ? &it->second : nullptr;
+    }
+
+    Level* find(Price price){ return const_cast<Level*>(static_cast<const PriceLadder*>(this)->find(price)); }
+
+    Level& operator[](Price price){ // find or create the level at price
+        if(in_band(price)){
+            if(levels.empty()){ // allocate the band on first use
+                levels.resize(band_high - band_low + 1);
+                occupied.resize(levels.size());
+            }
+
+            size_t slot = price - band_low;
+            if(!levels[slot]){
+                levels[slot].emplace();
+                occupied.set(slot);
+                added(price);
+            }
+            return *levels[slot];
+        }
+
+        auto [it, inserted] = overflow.try_emplace(price);
+        if(inserted){
+            added(price);
+        }
+        return it->second;
+    }
+
+    void erase(Price price){
+        if(in_band(price)){
+            if(levels.empty()){
+                return;
+            }
+            size_t slot = price - band_low;
+            if(levels[slot]){
+                levels[slot].reset();
+                occupied.clear(slot);
+                removed(price);
+            }
+            return;
+        }
+        if(overflow.erase(price)){
+            removed(price);
+        }
+    }
+
+    void clear(){ // drop every level, the band keeps its storage so refilling it does not allocate
+        if(!levels.empty() && high != NO_PRICE && low <= band_high && high >= band_low){
+            for(long slot = occupied.next(low < band_low ? 0 : low - band_low); slot >= 0; slot = occupied.next(slot + 1)){
+                levels[slot].reset();
+                occupied.clear(slot);
+            }
+        }
+        overflow.clear();
+        level_count = 0;
+        low = high = NO_PRICE;
+    }
+
+    Price lowest() const { return low; }   // lowest level, or NO_PRICE
+    Price highest() const { return high; } // highest level, or NO_PRICE
+
+    Price next_higher(Price price) const { // lowest level strictly above price, or NO_PRICE
+        Price best = NO_PRICE;
+
+        auto it = overflow.upper_bound(price);
+        if(it != overflow.end()){
+            best = it->first;
+        }
+
+        if(!levels.empty() && price < band_high){
+            long slot = occupied.next(price < band_low ? 0 : price - band_low + 1);
+            if(slot >= 0 && (best == NO_PRICE || band_low + slot < best)){
+                best = band_low + slot;
+            }
+        }
+        return best;
+    }
+
+    Price next_lower(Price price) const { // highest level strictly below price, or NO_PRICE
+        Price best = NO_PRICE;
+
+        auto it = overflow.lower_bound(price);
+        if(it != overflow.begin()){
+            best = std::prev(it)->first;
+        }
+
+        if(!levels.empty() && price > band_low){
+            long slot = occupied.prev(price > band_high ? levels.size() - 1 : price - band_low - 1);
+            if(slot >= 0 && band_low + slot > best){
+                best = band_low + slot;
+            }
+        }
+        return best;
+    }
+
+private:
+    bool in_band(Price price) const { return price >= band_low && price <= band_high; }
+
+    void added(Price price){
+        ++level_count;
+        if(low == NO_PRICE || price < low) low = price;
+        if(price > high) high = price; // NO_PRICE is below every price
+    }
+
+    void removed(Price price){
+        if(--level_count == 0){
+            low = high = NO_PRICE;
+            return;
+        }
+        if(price == low) low = next_higher(price);
+        if(price == high) high = next_lower(price);
+    }
+
+    Price band_low;
+    Price band_high;
+    std::vector<std::optional<Level>> levels; // slot i holds price band_low + i, allocated lazily
+    LevelBitmap occupied; // bit i set when levels[i] holds a level
+    std::map<Price, Level> overflow; // levels outside the band
+    size_t level_count = 0;
+    Price low = NO_PRICE;  // cached lowest()
+    Price high = NO_PRICE; // cached highest()
+};
+
+#endif
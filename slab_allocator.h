@@ -0,0 +1,90 @@
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+// Node arena for node based containers such as the OrderBook's order_index
+//
+// Nodes up to node_size bytes are carved out of slabs of slab_nodes nodes and go back to a free list when the
+// container erases them, so a container that erases as often as it inserts stops calling malloc once it has reached
+// its peak size. Arrays, such as hash bucket tables, and anything larger than a node go to operator new as usual.
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+class NodeArena {
+public:
+    static const size_t node_size = 32;   // a hash map node of a small key and value
+    static const size_t slab_nodes = 4096;
+
+    NodeArena() = default;
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    void* allocate(){
+        if(free_list != nullptr){
+            FreeNode* node = free_list;
+            free_list = node->next;
+            return node;
+        }
+        if(next_node == slab_nodes * node_size){
+            slabs.emplace_back(new Node[slab_nodes]); // the only malloc, once per slab_nodes nodes at a new peak
+            next_node = 0;
+        }
+        void* node = reinterpret_cast<unsigned char*>(slabs.back().get()) + next_node;
+        next_node += node_size;
+        return node;
+    }
+
+    void deallocate(void* node){
+        FreeNode* released = static_cast<FreeNode*>(node);
+        released->next = free_list;
+        free_list = released;
+    }
+
+private:
+    struct alignas(std::max_align_t) Node { unsigned char bytes[node_size]; };
+    struct FreeNode { FreeNode* next; };
+
+    std::vector<std::unique_ptr<Node[]>> slabs;
+    size_t next_node = slab_nodes * node_size; // byte offset of the next unused node in the current slab, full until the first slab exists
+    FreeNode* free_list = nullptr;
+};
+
+
+// Standard allocator drawing single nodes from a NodeArena, copies share the arena
+template <class T>
+class SlabAllocator {
+public:
+    typedef T value_type;
+
+    explicit SlabAllocator(NodeArena* arena = nullptr) : arena(arena) {}
+    template <class U> SlabAllocator(const SlabAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n){
+        if(pooled(n)){
+            return static_cast<T*>(arena->allocate());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n){
+        if(pooled(n)){
+            arena->deallocate(p);
+            return;
+        }
+        ::operator delete(p);
+    }
+
+    template <class U> bool operator==(const SlabAllocator<U>& other) const { return arena == other.arena; }
+    template <class U> bool operator!=(const SlabAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+    template <class U> friend class SlabAllocator;
+
+    bool pooled(size_t n) const { return n == 1 && arena != nullptr && sizeof(T) <= NodeArena::node_size && alignof(T) <= alignof(std::max_align_t); }
+
+    NodeArena* arena;
+};
+
+#endif
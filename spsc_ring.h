@@ -0,0 +1,110 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+// Bounded lock-free ring between one producer thread and one consumer thread
+//
+// The producer fills slots in place (claim, then commit) and publishes them in groups, the consumer reads whole
+// contiguous runs of published slots (peek) and hands them back in one step (release). Producer and consumer
+// indices live on separate cache lines and each side keeps a cached copy of the other's index, so the shared
+// atomics are only touched when the cached view runs out.
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+template <class T>
+class SpscRing {
+public:
+    static const size_t cache_line = 64;
+    static const size_t publish_every = 64; // committed slots are made visible at least this often
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    explicit SpscRing(size_t min_capacity){ // capacity is rounded up to a power of two
+        size_t capacity = 1;
+        while(capacity < min_capacity){
+            capacity <<= 1;
+        }
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    // producer side
+
+    T* claim(){ // next free slot to fill, or nullptr while the ring is full
+        if(write_pos - cached_head == slots.size()){
+            cached_head = head.load(std::memory_order_acquire);
+            if(write_pos - cached_head == slots.size()){
+                publish(); // the consumer may be waiting on slots we have not published yet
+                return nullptr;
+            }
+        }
+        return &slots[write_pos & mask];
+    }
+
+    void commit(){ // the claimed slot is filled
+        ++write_pos;
+        if(write_pos - published_pos >= publish_every){
+            publish();
+        }
+    }
+
+    void publish(){
+        published_pos = write_pos;
+        tail.store(write_pos, std::memory_order_release);
+    }
+
+    void close(){ // no more slots will be committed
+        publish();
+        done.store(true, std::memory_order_release);
+    }
+
+    void reopen(){ // take slots again after close, only once the consumer has seen the ring drained and stopped polling
+        done.store(false, std::memory_order_relaxed);
+    }
+
+    // consumer side
+
+    size_t peek(T*& first){ // contiguous run of published slots starting at first, 0 when none are available
+        if(read_pos == cached_tail){
+            cached_tail = tail.load(std::memory_order_acquire);
+            if(read_pos == cached_tail){
+                return 0;
+            }
+        }
+        size_t offset = read_pos & mask;
+        size_t run = cached_tail - read_pos;
+        first = &slots[offset];
+        return run < slots.size() - offset ? run : slots.size() - offset;
+    }
+
+    void release(size_t n){ // the first n peeked slots may be reused
+        read_pos += n;
+        head.store(read_pos, std::memory_order_release);
+    }
+
+    bool drained(){ // closed and every published slot consumed
+        return done.load(std::memory_order_acquire) && tail.load(std::memory_order_acquire) == read_pos;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    alignas(cache_line) std::atomic<size_t> tail{0}; // slots before tail are published
+    std::atomic<bool> done{false};
+
+    alignas(cache_line) std::atomic<size_t> head{0}; // slots before head are released
+
+    alignas(cache_line) size_t write_pos = 0; // producer only
+    size_t published_pos = 0;
+    size_t cached_head = 0;
+
+    alignas(cache_line) size_t read_pos = 0; // consumer only
+    size_t cached_tail = 0;
+};
+
+#endif
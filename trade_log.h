@@ -0,0 +1,197 @@
+#ifndef TRADE_LOG_H
+#define TRADE_LOG_H
+
+// Trade events
+//
+// Every fill in OrderBook::process_orders* becomes a 32 byte Trade pushed into a TradeFeed, a preallocated
+// SpscRing. Pushing never allocates or waits: when the ring is full the event is dropped and counted, and the
+// sequence numbers keep counting so a reader can see the gap. TradeLogWriter drains a feed on its own thread into
+//
+//   binary   TradeLogHeader (32 bytes) followed by Trade records, 32 bytes little-endian each
+//   csv      Seq,Aggressor_ID,Resting_ID,Ticker,Price,Volume with decimal prices
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "order.h"
+#include "order_log.h" // store_le
+#include "spsc_ring.h"
+
+struct Trade { // one fill, 32 bytes
+    uint64_t seq;          // per book, one per fill starting at 1, including dropped ones
+    int32_t aggressor_id;  // incoming order
+    int32_t resting_id;    // order it filled against
+    int32_t ticker;
+    int32_t volume;
+    Price price;           // in ticks, the resting order's price
+};
+static_assert(std::is_trivially_copyable<Trade>::value && sizeof(Trade) == 32, "Trade should stay a compact POD record");
+
+const uint32_t TRADE_LOG_VERSION = 1;
+const char TRADE_LOG_MAGIC[8] = {'C', 'L', 'O', 'B', 'T', 'R', 'D', '\0'};
+
+struct TradeLogHeader {
+    char magic[8];         // TRADE_LOG_MAGIC
+    uint32_t version;      // TRADE_LOG_VERSION
+    uint32_t record_size;  // sizeof(Trade)
+    double tick_size;      // price increment of one tick in the records
+    uint64_t reserved;
+};
+static_assert(sizeof(TradeLogHeader) == 32, "TradeLogHeader is 32 bytes on disk");
+
+
+inline void encode_trade(unsigned char* out, const Trade& trade){
+    store_le(out + 0, trade.seq);
+    store_le(out + 8, trade.aggressor_id);
+    store_le(out + 12, trade.resting_id);
+    store_le(out + 16, trade.ticker);
+    store_le(out + 20, trade.volume);
+    store_le(out + 24, trade.price);
+}
+
+
+// Bounded queue of trade events from one matching thread to one reader
+class TradeFeed {
+public:
+    static const size_t default_capacity = 1 << 16;
+
+    explicit TradeFeed(size_t capacity = default_capacity) : ring(capacity) {}
+
+    // matching thread
+
+    void push(const Trade& trade){ // never blocks, a full ring drops the event
+        Trade* slot = ring.claim();
+        if(slot == nullptr){
+            dropped_count.store(dropped_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        *slot = trade;
+        ring.commit();
+    }
+
+    void flush(){ ring.publish(); } // make pushed events visible now instead of at the next group boundary
+    void close(){ ring.close(); }   // no more events will be pushed
+
+    uint64_t dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+
+    // reader thread
+
+    size_t peek(Trade*& first){ return ring.peek(first); }
+    void release(size_t n){ ring.release(n); }
+    bool drained(){ return ring.drained(); }
+
+private:
+    SpscRing<Trade> ring;
+    std::atomic<uint64_t> dropped_count{0};
+};
+
+
+// Writes the events of its feed to a file from a background thread, csv when the path ends in .csv
+class TradeLogWriter {
+public:
+    TradeLogWriter(const TradeLogWriter&) = delete;
+    TradeLogWriter& operator=(const TradeLogWriter&) = delete;
+
+    TradeLogWriter(const std::string& path, double tick_size, size_t capacity = TradeFeed::default_capacity)
+        : path(path), tick_size(tick_size), csv(path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0), trades(capacity) {
+        file = std::fopen(path.c_str(), csv ? "w" : "wb");
+        if(file == nullptr){
+            throw std::runtime_error("Can not create file \"" + path + "\"");
+        }
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+        if(csv){
+            while(price_decimals < 9 && std::fabs(tick_size * std::pow(10.0, price_decimals) - std::llround(tick_size * std::pow(10.0, price_decimals))) > 1e-9){
+                ++price_decimals; // enough digits to print any multiple of tick_size exactly
+            }
+            std::fputs("Seq,Aggressor_ID,Resting_ID,Ticker,Price,Volume\n", file);
+        }
+        else{
+            unsigned char header[sizeof(TradeLogHeader)] = {};
+            std::memcpy(header, TRADE_LOG_MAGIC, sizeof(TRADE_LOG_MAGIC));
+            store_le(header + 8, TRADE_LOG_VERSION);
+            store_le(header + 12, (uint32_t)sizeof(Trade));
+            store_le(header + 16, tick_size);
+            std::fwrite(header, 1, sizeof(header), file);
+        }
+
+        writer = std::thread([this]{ drain(); });
+    }
+
+    ~TradeLogWriter(){
+        try{
+            finish();
+        }
+        catch(...){
+        }
+    }
+
+    TradeFeed& feed(){ return trades; } // hand to OrderBook::publish_trades
+
+    void finish(){ // close the feed, write what is left and close the file, call once matching has stopped
+        if(file == nullptr){
+            return;
+        }
+        trades.close();
+        writer.join();
+
+        bool failed = std::ferror(file) != 0;
+        failed |= std::fclose(file) != 0;
+        file = nullptr;
+        if(failed){
+            throw std::runtime_error("Can not write file \"" + path + "\"");
+        }
+    }
+
+    uint64_t written() const { return written_count; } // valid after finish
+    uint64_t dropped() const { return trades.dropped(); }
+
+private:
+    void drain(){
+        for(;;){
+            Trade* batch;
+            size_t n = trades.peek(batch);
+            if(n == 0){
+                if(trades.drained()){
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100)); // idle, stay off the matching core
+                continue;
+            }
+            for(size_t i = 0; i < n; ++i){
+                write(batch[i]);
+            }
+            written_count += n;
+            trades.release(n);
+        }
+    }
+
+    void write(const Trade& trade){
+        if(csv){
+            std::fprintf(file, "%llu,%d,%d,%d,%.*f,%d\n", (unsigned long long)trade.seq, trade.aggressor_id, trade.resting_id,
+                         trade.ticker, price_decimals, trade.price * tick_size, trade.volume);
+        }
+        else{
+            unsigned char record[sizeof(Trade)];
+            encode_trade(record, trade);
+            std::fwrite(record, sizeof(record), 1, file);
+        }
+    }
+
+    std::string path;
+    double tick_size;
+    bool csv;
+    int price_decimals = 0;
+    FILE* file = nullptr;
+    uint64_t written_count = 0; // writer thread only until finish
+    TradeFeed trades;
+    std::thread writer;
+};
+
+#endif